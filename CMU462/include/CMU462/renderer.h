@@ -53,6 +53,14 @@ class Renderer {
    */
   virtual void resize( size_t w, size_t h ) = 0;
 
+  /**
+   * Report whether there is anything new to draw.
+   * The viewer only draws a frame when the renderer needs one (or the window
+   * itself changed) and otherwise sleeps until the next event. Renderers
+   * that do not override this are drawn continuously.
+   */
+  virtual bool needs_render( void ) { return true; }
+
  /**
    * Return a name for the renderer.
    * If the viewer has a renderer set at initialization, it will include
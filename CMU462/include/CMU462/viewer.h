@@ -76,6 +76,7 @@ class Viewer {
   static void key_callback( GLFWwindow* window, int key, int scancode, int action, int mods );
   static void char_callback( GLFWwindow* window, unsigned int codepoint );
   static void resize_callback( GLFWwindow* window, int width, int height );
+  static void refresh_callback( GLFWwindow* window );
   static void cursor_callback( GLFWwindow* window, double xpos, double ypos );
   static void scroll_callback( GLFWwindow* window, double xoffset, double yoffset);
   static void mouse_button_callback( GLFWwindow* window, int button, int action, int mods );
@@ -91,6 +92,12 @@ class Viewer {
   // info toggle
   static bool showInfo;
 
+  // the window needs a new frame, whether or not the renderer does
+  static bool dirty;
+
+  // renderer info currently shown in the OSD
+  static std::string renderer_info;
+
   // window properties
   static GLFWwindow* window;
   static size_t buffer_w;
@@ -29,6 +29,10 @@ time_point<system_clock> Viewer::sys_curr;
 // draw toggles
 bool Viewer::showInfo = true;
 
+// frame state
+bool Viewer::dirty = true;
+string Viewer::renderer_info;
+
 // window properties
 GLFWwindow* Viewer::window;
 size_t Viewer::buffer_w;
@@ -81,6 +85,7 @@ void Viewer::init() {
 
   // framebuffer event callbacks
   glfwSetFramebufferSizeCallback( window, resize_callback );
+  glfwSetWindowRefreshCallback( window, refresh_callback );
   
   // key event callbacks
   glfwSetKeyCallback( window, key_callback );
@@ -153,25 +158,35 @@ void Viewer::set_renderer(Renderer *renderer) {
 }
 
 void Viewer::update() {
-  
-  // clear frame
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-  // run user renderer
-  if (renderer) {
-    renderer->render();
-  }
+  // draw a frame only if the window or the renderer changed
+  if( dirty || !renderer || renderer->needs_render() ) {
 
-  // draw info
-  if( showInfo ) {
-    drawInfo();        
-  } 
+    // clear frame
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-  // swap buffers
-  glfwSwapBuffers(window); 
+    // run user renderer
+    if (renderer) {
+      renderer->render();
+    }
+
+    // draw info
+    if( showInfo ) {
+      drawInfo();
+    }
+
+    // swap buffers
+    glfwSwapBuffers(window);
+    dirty = false;
+  }
 
-  // poll events
-  glfwPollEvents();
+  // sleep until the next event when idle, otherwise only pick up the
+  // events that arrived during the frame
+  if( !dirty && renderer && !renderer->needs_render() ) {
+    glfwWaitEvents();
+  } else {
+    glfwPollEvents();
+  }
 }
 
 
@@ -199,16 +214,11 @@ void Viewer::drawInfo() {
   
   }
 
-  // udpate renderer OSD
-  // TODO: This is done on every update and it shouldn't be!
-  // The viewer should only update when the renderer needs to
-  // update the info text. 
-  if (renderer) {
-    string renderer_info = renderer->info();
-    osd_text->set_text(line_id_renderer, renderer_info);
-  } else {
-    string renderer_info = "No input renderer";
-    osd_text->set_text(line_id_renderer, renderer_info);
+  // update renderer OSD when the renderer's info changes
+  string info = renderer ? renderer->info() : "No input renderer";
+  if (info != renderer_info) {
+    osd_text->set_text(line_id_renderer, info);
+    renderer_info = info;
   }
 
   // render OSD
@@ -235,6 +245,13 @@ void Viewer::resize_callback( GLFWwindow* window, int width, int height ) {
 
   // resize render if there is a user space renderer
   if (renderer) renderer->resize( buffer_w, buffer_h );  
+  dirty = true;
+}
+
+void Viewer::refresh_callback( GLFWwindow* window ) {
+
+  // the window contents were damaged (uncovered, restored, ...)
+  dirty = true;
 }
 
 void Viewer::cursor_callback( GLFWwindow* window, double xpos, double ypos ) {
@@ -273,6 +290,7 @@ void Viewer::key_callback( GLFWwindow* window,
       glfwSetWindowShouldClose( window, true ); 
     } else if( key == GLFW_KEY_GRAVE_ACCENT ){
       showInfo = !showInfo;
+      dirty = true;
     } 
   }
   
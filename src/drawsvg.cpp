@@ -1,8 +1,10 @@
+#include "GL/glew.h"
 #include "drawsvg.h"
 
 #include <sstream>
 #include <iostream>
 #include <cstdlib>
+#include <future>
 
 using namespace std;
 
@@ -10,12 +12,15 @@ namespace CMU462 {
 
 DrawSVG::~DrawSVG() {
 
-  tabs.clear();
   viewport_imp.clear();
   viewport_ref.clear();
 
   delete hardware_renderer;
 
+  if (zoom_texture) glDeleteTextures(1, &zoom_texture);
+  if (display_texture) glDeleteTextures(1, &display_texture);
+  if (display_buffer) glDeleteBuffers(1, &display_buffer);
+
   delete software_renderer_imp;
   delete software_renderer_ref;
 
@@ -38,9 +43,19 @@ string DrawSVG::info() {
     if (software_renderer == software_renderer_ref) {
       osd += "- Reference";
     }
-    if (sample_rate > 1) {
+    AAMethod aa_method = software_renderer == software_renderer_imp ?
+                         software_renderer_imp->get_aa_method() : SSAA;
+    if (aa_method == COVERAGE) {
+      osd += "(Coverage AA)";
+    } else if (aa_method == MSAA && sample_rate > 1) {
+      osd += "( " + to_string(sample_rate * sample_rate) + "x MSAA)";
+    } else if (sample_rate > 1) {
       osd += "( " + to_string(sample_rate * sample_rate) + "x SSAA)";
     }
+    if (software_renderer == software_renderer_imp &&
+        software_renderer_imp->get_line_aa()) {
+      osd += "(AA lines)";
+    }
   }
 
   return osd;
@@ -64,24 +79,9 @@ void DrawSVG::init() {
   software_renderer_imp->set_tex_sampler(sampler_imp);
   software_renderer_ref->set_tex_sampler(sampler_ref);
 
-  // generate mipmaps & set initial viewports
-  for (size_t i = 0; i < tabs.size(); ++i) {
-
-    viewport_imp.push_back(new ViewportImp());
-    viewport_ref.push_back(new ViewportRef());
-
-    // auto adjust
-    auto_adjust(i);
-
-    // set initial svg_2_norm for imp using ref
-    viewport_imp[i]->set_svg_2_norm(viewport_ref[i]->get_svg_2_norm());
-
-    // generate mipmaps
-    regenerate_mipmap(i);
-  }
-
-  // set tab and transformation if tabs loaded
+  // tabs are set up when first shown, start at the first that loads
   current_tab = 0;
+  setTab(0);
 
   // initial osd
   osd = "Software Renderer";
@@ -90,18 +90,35 @@ void DrawSVG::init() {
 
 void DrawSVG::render() {
 
-  if (method == Hardware ) {
+  // input since the last frame is drawn once here, however many events
+  // asked for it; hardware frames are drawn every time anyway. A pass with
+  // nothing to redraw means the view has settled, the neighbors are drawn
+  // in the background from then on
+  if (method == Hardware || redraw_pending) {
     redraw();
+  } else if (prerender_pending) {
+    prerender_pending = false;
+    trim_tabs(current_tab);
+    prerender_neighbors();
   }
 
+  // the reference renderer draws into a framebuffer of its own
+  const unsigned char* pixels = nullptr;
   if( method == Software ) {
-    display_pixels( &framebuffer[0] );
+    bool reference = software_renderer == software_renderer_ref && !show_diff;
+    pixels = reference ? &reference_framebuffer[0] : &framebuffer[0];
+    display_pixels( pixels );
   }
 
   if (show_zoom) {
-    draw_zoom();
+    draw_zoom( pixels );
   }
 
+  present_pending = false;
+}
+
+bool DrawSVG::needs_render() {
+  return redraw_pending || present_pending || prerender_pending;
 }
 
 void DrawSVG::resize( size_t width, size_t height ) {
@@ -112,7 +129,8 @@ void DrawSVG::resize( size_t width, size_t height ) {
   // resize render target
   framebuffer.resize( 4 * width * height);
   software_renderer_imp->set_render_target(&framebuffer[0], width, height);
-  software_renderer_ref->set_render_target(&framebuffer[0], width, height);
+  reference_framebuffer.resize( 4 * width * height);
+  software_renderer_ref->set_render_target(&reference_framebuffer[0], width, height);
 
   // update hardware renderer
   hardware_renderer->resize(width, height);
@@ -123,7 +141,7 @@ void DrawSVG::resize( size_t width, size_t height ) {
   norm_to_screen(1,1) = scale; norm_to_screen(1,2) = (height - scale) / 2;
 
   // redraw current tab with updated transformation
-  redraw();
+  request_redraw();
 }
 
 void DrawSVG::char_event( unsigned int key ) {
@@ -133,7 +151,7 @@ void DrawSVG::char_event( unsigned int key ) {
     // reset view transformation
     case ' ':
       auto_adjust(current_tab);
-      redraw();
+      request_redraw();
       break;
 
     // SSAA controls
@@ -144,6 +162,22 @@ void DrawSVG::char_event( unsigned int key ) {
       dec_sample_rate();
       break;
 
+    // cycle through SSAA, MSAA and analytic coverage AA (imp renderer only)
+    case 'a': case 'A':
+      switch (software_renderer_imp->get_aa_method()) {
+        case SSAA: software_renderer_imp->set_aa_method(MSAA); break;
+        case MSAA: software_renderer_imp->set_aa_method(COVERAGE); break;
+        default: software_renderer_imp->set_aa_method(SSAA); break;
+      }
+      request_redraw();
+      break;
+
+    // toggle antialiased lines (imp renderer only)
+    case 'l': case 'L':
+      software_renderer_imp->set_line_aa(!software_renderer_imp->get_line_aa());
+      request_redraw();
+      break;
+
     // switch between iml and ref renderer
     case 'r': case 'R':
       if (software_renderer == software_renderer_imp) {
@@ -155,11 +189,11 @@ void DrawSVG::char_event( unsigned int key ) {
     // switch between iml and ref sampler
     case ';':
       sampler = sampler_imp;
-      regenerate_mipmap(current_tab); redraw();
+      regenerate_mipmap(current_tab); request_redraw();
       break;
     case '\'':
       sampler = sampler_ref;
-      regenerate_mipmap(current_tab); redraw();
+      regenerate_mipmap(current_tab); request_redraw();
       break;
 
     // change render method
@@ -174,13 +208,36 @@ void DrawSVG::char_event( unsigned int key ) {
     case 'd': case 'D':
       if (method == Software) {
         show_diff = !show_diff; 
-        redraw();
+        request_redraw();
+      }
+      break;
+
+    // diff tolerance
+    case '[':
+      if (show_diff && diff_tolerance > 0) {
+        diff_tolerance--;
+        request_redraw();
+      }
+      break;
+    case ']':
+      if (show_diff && diff_tolerance < 255) {
+        diff_tolerance++;
+        request_redraw();
       }
       break;
 
     // toggle zoom
     case 'z': case 'Z':
       show_zoom = !show_zoom;
+      present_pending = true;
+      break;
+
+    // previous and next tab
+    case ',':
+      if (tabs.size()) setTab((current_tab + tabs.size() - 1) % tabs.size());
+      break;
+    case '.':
+      if (tabs.size()) setTab((current_tab + 1) % tabs.size());
       break;
 
     // tab selection
@@ -242,32 +299,29 @@ void DrawSVG::mouse_event(int key, int event, unsigned char mods) {
 void DrawSVG::cursor_event( float x, float y ) {
   
   // translate when left mouse button is held down
-  // diff is disabled when panning - it's too slow
   if (leftDown) {
   
-    show_diff = false;
-    float dx = (x - cursor_x) / width  * tabs[current_tab]->width;
-    float dy = (y - cursor_y) / height * tabs[current_tab]->height;
+    float dx = (x - cursor_x) / width  * tabs.svg(current_tab)->width;
+    float dy = (y - cursor_y) / height * tabs.svg(current_tab)->height;
     viewport_imp[current_tab]->update_viewbox(dx, dy, 1);
     viewport_ref[current_tab]->update_viewbox(dx, dy, 1);
-    redraw();
+    request_redraw();
   }
   
-  // register new cursor location
+  // register new cursor location, the zoom view follows it
   cursor_x = x;
   cursor_y = y;
+  if (show_zoom) present_pending = true;
 }
 
 void DrawSVG::scroll_event( float offset_x, float offset_y ) {
-  // diff is disabled when zooming - it's too slow
   if (offset_x || offset_y) {
-    show_diff = false;
     // prevent inverting axis when scrolling too fast
     float scale = 1 + 0.05 * offset_x + 0.05 * offset_y;
     scale = scale < 0.5 ? 0.5 : (scale > 1.5 ? 1.5 : scale); 
     viewport_imp[current_tab]->update_viewbox(0, 0, scale);
     viewport_ref[current_tab]->update_viewbox(0, 0, scale);
-    redraw();
+    request_redraw();
   }
 }
 
@@ -282,17 +336,48 @@ void DrawSVG::clear( void ) {
   }
 }
 
-void DrawSVG::newTab( SVG* svg ) {
-  if (tabs.size() < 9) {
-    tabs.push_back(svg);
-  } else {
-    fprintf(stderr, "DrawSVG can only hold up to 9 tabs");
-  }
+void DrawSVG::newTab( SVG* svg, const string& path ) {
+  tabs.add(svg, path);
+  viewport_imp.push_back(nullptr);
+  viewport_ref.push_back(nullptr);
+}
+
+void DrawSVG::newTab( const string& path ) {
+  tabs.add(path);
+  viewport_imp.push_back(nullptr);
+  viewport_ref.push_back(nullptr);
 }
 
 void DrawSVG::delTab( size_t tab_index ) {
   if (tab_index < tabs.size()) {
-    tabs.erase(tabs.begin() + tab_index);
+
+    if (tabs.svg(tab_index)) {
+      prerenderer.forget(tabs.svg(tab_index));
+      hardware_renderer->forget_svg(*tabs.svg(tab_index));
+      software_renderer_imp->forget_svg();
+    } else if (SVG* loaded = prerenderer.take_loaded(tabs.path(tab_index))) {
+      prerenderer.forget(loaded);
+      delete loaded;
+    }
+    tabs.remove(tab_index);
+    delete viewport_imp[tab_index];
+    delete viewport_ref[tab_index];
+    viewport_imp.erase(viewport_imp.begin() + tab_index);
+    viewport_ref.erase(viewport_ref.begin() + tab_index);
+
+    if (tab_index < previous_tab) {
+      previous_tab--;
+    } else if (tab_index == previous_tab) {
+      previous_tab = current_tab;
+    }
+
+    // keep showing the same tab, or its successor if it was the one deleted
+    if (tab_index < current_tab) {
+      current_tab--;
+    } else if (tab_index == current_tab) {
+      imp_frame = false;
+      if (tabs.size()) setTab(min(current_tab, tabs.size() - 1));
+    }
   }
 }
 
@@ -300,52 +385,157 @@ void DrawSVG::setTab( size_t tab_index ) {
 
   if ( tab_index < tabs.size() ) {
 
+    // frames drawn in the background are only good for the software
+    // renderer with its own sampler
+    bool cached = method == Software && !show_diff && !framebuffer.empty() &&
+                  software_renderer == software_renderer_imp &&
+                  sampler == sampler_imp;
+
+    // keep the frame of the tab being left, it may be shown again soon
+    if (cached && imp_frame && !redraw_pending && tab_index != current_tab) {
+      update_framebuffer();
+      prerenderer.store(tabs.svg(current_tab), view_of(current_tab),
+                        &framebuffer[0]);
+    }
+
+    // take over a svg loaded in the background, or the worker drawing it
+    if (!tabs.svg(tab_index)) {
+      SVG* loaded = prerenderer.take_loaded(tabs.path(tab_index));
+      if (loaded) tabs.adopt(tab_index, loaded);
+    } else {
+      prerenderer.wait(tabs.svg(tab_index));
+    }
+
+    // tabs whose file can not be loaded (anymore) are dropped
+    if (!load_tab(tab_index)) {
+      cerr << "[DrawSVG] Could not load " << tabs.path(tab_index) << endl;
+      delTab(tab_index);
+      return;
+    }
+
     // switch tab and update transformation
+    if (tab_index != current_tab) previous_tab = current_tab;
     current_tab = tab_index;
 
+    // show the frame drawn before if the view is still the same, the
+    // renderer itself holds no frame of this tab though
+    if (cached && prerenderer.fetch(tabs.svg(tab_index), view_of(tab_index),
+                                    &framebuffer[0])) {
+      imp_frame = false;
+      buffer_frame = texture_frame = false;
+      redraw_pending = false;
+      present_pending = true;
+      prerender_pending = false;
+      prerender_neighbors();
+      return;
+    }
+
     // update output
-    redraw();
+    request_redraw();
   }
 }
 
-void DrawSVG::draw_diff() {
+void DrawSVG::setMemoryBudget( size_t bytes ) {
+  tabs.set_budget(bytes);
+}
 
-  // get reference output
-  software_renderer_ref->draw_svg(*tabs[current_tab]);
-  
-  // save reference output
-  vector<unsigned char> reference ( 4 * width * height );
-  memcpy(&reference[0], &framebuffer[0], 4 * width * height );
-  memset(&framebuffer[0], 255, 4 * width * height);
-
-  // get implementation output
-  software_renderer_imp->draw_svg(*tabs[current_tab]);
-
-  // take difference and count errors
-  int errorCount = 0;
-  for( size_t i = 0; i < width * height; i++ ) {
-
-    framebuffer[i*4 + 0] = abs(reference[i*4 + 0] - framebuffer[i*4 + 0]);
-    framebuffer[i*4 + 1] = abs(reference[i*4 + 1] - framebuffer[i*4 + 1]);
-    framebuffer[i*4 + 2] = abs(reference[i*4 + 2] - framebuffer[i*4 + 2]);
-    framebuffer[i*4 + 3] = 255;
-
-    for( int k = 0; k < 3; k++ ) {
-      if( framebuffer[i*4+k] ) {
-        errorCount++;
-        break;
-      }
+bool DrawSVG::load_tab( size_t tab_index ) {
+
+  SVG* svg = tabs.acquire(tab_index);
+  if (!svg) return false;
+
+  // the view is fit to the canvas the first time a tab is shown, and kept
+  // while the tab is released
+  if (!viewport_imp[tab_index]) {
+    viewport_imp[tab_index] = new ViewportImp();
+    viewport_ref[tab_index] = new ViewportRef();
+    auto_adjust(tab_index);
+    viewport_imp[tab_index]->set_svg_2_norm(viewport_ref[tab_index]->get_svg_2_norm());
+  }
+
+  // generate mipmaps (compiled scenes already carry theirs)
+  regenerate_mipmap(tab_index, true);
+
+  trim_tabs(tab_index);
+  return true;
+}
+
+void DrawSVG::trim_tabs( size_t keep ) {
+
+  // make room by releasing the tabs least recently shown, svgs loaded in
+  // the background count toward the budget too
+  vector<SVG*> released = tabs.trim(keep, prerenderer.loaded_bytes());
+  for (size_t i = 0; i < released.size(); ++i) {
+    prerenderer.forget(released[i]);
+    hardware_renderer->forget_svg(*released[i]);
+    software_renderer_imp->forget_svg();
+    delete released[i];
+  }
+}
+
+Prerenderer::View DrawSVG::view_of( size_t tab_index ) const {
+
+  Prerenderer::View view = {
+    width, height, norm_to_screen * viewport_imp[tab_index]->get_svg_2_norm(),
+    sample_rate, software_renderer_imp->get_aa_method(),
+    software_renderer_imp->get_line_aa()
+  };
+  return view;
+}
+
+void DrawSVG::prerender_neighbors() {
+
+  // the next and previous tab, and the one shown before
+  vector<Prerenderer::Request> requests;
+  size_t n = tabs.size();
+  size_t candidates[] = { (current_tab + 1) % n, (current_tab + n - 1) % n,
+                          previous_tab };
+  for (size_t i = 0; i < 3 && width * height; ++i) {
+
+    size_t tab = candidates[i];
+    if (tab == current_tab || tab >= n) continue;
+    if (find(candidates, candidates + i, tab) != candidates + i) continue;
+
+    // resident tabs are drawn as they were left, released ones are loaded
+    // (and fit if never shown) first; tabs handed a svg are set up on show
+    Prerenderer::Request request = { tabs.svg(tab), tabs.path(tab) };
+    if (viewport_imp[tab]) {
+      request.view = view_of(tab);
+    } else if (!tabs.svg(tab)) {
+      request.view = view_of(current_tab);
+      request.fit = true;
+      request.norm_to_screen = norm_to_screen;
+    } else {
+      continue;
     }
-  
-    osd = to_string(errorCount) + " pixels different";
+    requests.push_back(request);
   }
+  prerenderer.request(requests);
+}
+
+void DrawSVG::draw_diff() {
+
+  // both renderers draw at once, each into its own framebuffer
+  SVG& svg = *tabs.svg(current_tab);
+  future<void> reference = async( launch::async, [this, &svg]() {
+    software_renderer_ref->draw_svg(svg);
+  });
+  software_renderer_imp->draw_svg(svg);
+  reference.get();
+
+  // take difference and score it
+  diff_metrics = compare_images( &reference_framebuffer[0], &framebuffer[0],
+                                 width, height, diff_tolerance,
+                                 &framebuffer[0] );
+  osd = diff_metrics.summary();
 
 }
 
-void DrawSVG::draw_zoom() {
+void DrawSVG::draw_zoom( const unsigned char* pixels ) {
 
   // size (in pixels) of region of interest
   const size_t regionSize = 32;
+  if( width < regionSize || height < regionSize ) return;
   
   // relative size of zoom window
   size_t zoomFactor = 16;
@@ -358,56 +548,84 @@ void DrawSVG::draw_zoom() {
   }
   size_t zoomSize = regionSize * zoomFactor;
 
-  // adjust the cursor coordinates so that the region of
-  // interest never goes outside the bounds of the framebuffer
-  size_t cX = max( regionSize/2, min( width-regionSize/2-1, (size_t) cursor_x ));
-  size_t cY = max( regionSize/2, min( height-regionSize/2-1, height - (size_t) cursor_y ));
-
-  // grab pixels from the region of interest
-  vector<unsigned char> windowPixels( 3*regionSize*regionSize );
-  glReadPixels( cX - regionSize/2,
-                cY - regionSize/2 + 1, // meh
-                regionSize,
-                regionSize,
-                GL_RGB,
-                GL_UNSIGNED_BYTE,
-                &windowPixels[0] );
-
-  // upsample by the zoom factor, highlighting pixel boundaries
-  vector<unsigned char> zoomPixels( 3*zoomSize*zoomSize );
-  unsigned char* wp = &windowPixels[0];
-  // outer loop over pixels in region of interest
-  for( int y = 0; y < regionSize; y++ ) {
-   int y0 = y*zoomFactor;
-   for( int x = 0; x < regionSize; x++ ) {
-      int x0 = x*zoomFactor;
-      unsigned char* zp = &zoomPixels[ ( x0 + y0*zoomSize )*3 ];
-      // inner loop over upsampled block
-      for( int j = 0; j < zoomFactor; j++ ) {
-        for( int i = 0; i < zoomFactor; i++ ) {
-          for( int k = 0; k < 3; k++ ) {
-            // highlight pixel boundaries
-            if( i == 0 || j == 0 ) {
-              const float s = .3;
-              zp[k] = (int)( (1.-2.*s)*wp[k] + s*255. );
-            } else {
-              zp[k] = wp[k];
-            }
-          }
-          zp += 3;
-        }
-        zp += 3*( zoomSize - zoomFactor );
-      }
-      wp += 3;
-    }
+  // region of interest around the cursor (top row first), it never goes
+  // outside the bounds of the framebuffer
+  float half = regionSize / 2.f;
+  size_t x0 = max( 0.f, min( cursor_x - half, float(width - regionSize) ) );
+  size_t y0 = max( 0.f, min( cursor_y - half, float(height - regionSize) ) );
+
+  // the loupe is a texture kept between frames, with a texel per sample
+  // while the samples behind the frame are at hand
+  if( !zoom_texture ) {
+    glGenTextures( 1, &zoom_texture );
+    glBindTexture( GL_TEXTURE_2D, zoom_texture );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+  }
+  glBindTexture( GL_TEXTURE_2D, zoom_texture );
+
+  size_t rate = 0;
+  if( imp_frame ) {
+    zoom_samples.resize( 4 * regionSize * regionSize * sample_rate * sample_rate );
+    rate = software_renderer_imp->read_samples( x0, y0, regionSize, regionSize,
+                                                &zoom_samples[0] );
   }
 
-  // copy pixels to the screen using OpenGL
+  size_t texels = regionSize * max( rate, (size_t) 1 );
+  if( texels != zoom_texture_size ) {
+    glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA, texels, texels, 0,
+                  GL_RGBA, GL_UNSIGNED_BYTE, nullptr );
+    zoom_texture_size = texels;
+  }
+
+  // the hardware frame is copied on the gpu and arrives bottom row first
+  bool bottom_up = !pixels;
+  if( rate ) {
+    glTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0, texels, texels,
+                     GL_RGBA, GL_UNSIGNED_BYTE, &zoom_samples[0] );
+  } else if( pixels ) {
+    update_framebuffer();
+    glPixelStorei( GL_UNPACK_ROW_LENGTH, width );
+    glTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0, texels, texels,
+                     GL_RGBA, GL_UNSIGNED_BYTE, pixels + 4 * (x0 + y0 * width) );
+    glPixelStorei( GL_UNPACK_ROW_LENGTH, 0 );
+  } else {
+    glCopyTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0,
+                         x0, height - y0 - regionSize, texels, texels );
+  }
+
+  // draw the loupe in the top right corner
   glMatrixMode( GL_PROJECTION ); glPushMatrix(); glLoadIdentity(); glOrtho( 0, width, 0, height, 0.01, 1000. );
   glMatrixMode( GL_MODELVIEW  ); glPushMatrix(); glLoadIdentity(); glTranslated( 0., 0., -1. );
-  
-  glRasterPos2i( width-zoomSize, height-zoomSize );  
-  glDrawPixels( zoomSize, zoomSize, GL_RGB, GL_UNSIGNED_BYTE, &zoomPixels[0] );
+  glPushAttrib( GL_ENABLE_BIT | GL_CURRENT_BIT | GL_COLOR_BUFFER_BIT );
+
+  float left = width - zoomSize, bottom = height - zoomSize;
+  float top_t = bottom_up ? 1 : 0, bottom_t = 1 - top_t;
+  glEnable( GL_TEXTURE_2D );
+  glDisable( GL_BLEND );
+  glColor4f( 1, 1, 1, 1 );
+  glBegin( GL_QUADS );
+  glTexCoord2f( 0, bottom_t ); glVertex2f( left,  bottom );
+  glTexCoord2f( 1, bottom_t ); glVertex2f( width, bottom );
+  glTexCoord2f( 1, top_t );    glVertex2f( width, height );
+  glTexCoord2f( 0, top_t );    glVertex2f( left,  height );
+  glEnd();
+  glDisable( GL_TEXTURE_2D );
+
+  // highlight pixel boundaries
+  glEnable( GL_BLEND );
+  glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+  glColor4f( .5, .5, .5, .6 );
+  glBegin( GL_LINES );
+  for( size_t i = 0; i < regionSize; i++ ) {
+    float x = left + i * zoomFactor + .5f;
+    float y = bottom + i * zoomFactor + .5f;
+    glVertex2f( x, bottom ); glVertex2f( x, height );
+    glVertex2f( left, y );   glVertex2f( width, y );
+  }
+  glEnd();
+
+  glPopAttrib();
   glMatrixMode( GL_PROJECTION ); glPopMatrix();
   glMatrixMode( GL_MODELVIEW ); glPopMatrix();
 
@@ -416,10 +634,10 @@ void DrawSVG::draw_zoom() {
 
 void DrawSVG::inc_sample_rate() {
   if (method == Software) {
-    sample_rate += sample_rate < 4 ? 1 : 0;
+    sample_rate += sample_rate < SoftwareRendererImp::kMaxSampleRate ? 1 : 0;
     software_renderer_imp->set_sample_rate(sample_rate);
     software_renderer_ref->set_sample_rate(sample_rate);
-    redraw();
+    request_redraw();
   }
 }
 
@@ -428,12 +646,15 @@ void DrawSVG::dec_sample_rate() {
     sample_rate -= sample_rate > 1 ? 1 : 0;
     software_renderer_imp->set_sample_rate(sample_rate);
     software_renderer_ref->set_sample_rate(sample_rate);
-    redraw();
+    request_redraw();
   }
 }
 
 void DrawSVG::redraw() {
 
+  redraw_pending = false;
+  present_pending = true;
+  buffer_frame = texture_frame = false;
   clear();
 
   // set svg_2_screen transformation
@@ -446,63 +667,180 @@ void DrawSVG::redraw() {
   switch (method) {
 
     case Hardware:  
-      hardware_renderer->draw_svg(*tabs[current_tab]);
+      hardware_renderer->draw_svg(*tabs.svg(current_tab));
       break;
       
     case Software: 
 
-      if (show_diff) { draw_diff(); return; }
-      software_renderer->draw_svg(*tabs[current_tab]);
-      display_pixels( &framebuffer[0] );
+      if (show_diff) { draw_diff(); imp_frame = false; return; }
+
+      // our renderer resolves straight into the unpack buffer, the
+      // framebuffer only gets the frame once something reads it
+      if (software_renderer == software_renderer_imp) {
+        unsigned char* upload = map_display_buffer();
+        software_renderer_imp->set_upload_target(upload);
+        software_renderer->draw_svg(*tabs.svg(current_tab));
+        software_renderer_imp->set_upload_target(nullptr);
+        if (upload) {
+          buffer_frame = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE;
+          glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+      } else {
+        software_renderer->draw_svg(*tabs.svg(current_tab));
+      }
       break;
 
   }
+
+  imp_frame = method == Software && software_renderer == software_renderer_imp;
+  prerender_pending = imp_frame && sampler == sampler_imp;
 }
 
-void DrawSVG::regenerate_mipmap(size_t tab_index) {
-  if (tab_index < tabs.size()) {
-    SVG* svg = tabs[tab_index];
+int DrawSVG::getErrorCount() const {
+  return diff_metrics.error_count;
+}
+
+void DrawSVG::markDirty( SVGElement* element ) {
+  prerenderer.forget(tabs.svg(current_tab));
+  software_renderer_imp->mark_dirty(element);
+  hardware_renderer->mark_dirty(*tabs.svg(current_tab), element);
+}
+
+void DrawSVG::redrawDirty() {
+
+  if (!imp_frame || method != Software || show_diff ||
+      software_renderer != software_renderer_imp) {
+    redraw();
+    return;
+  }
+
+  // set svg_2_screen transformation
+  Matrix3x3 m_imp = norm_to_screen * viewport_imp[current_tab]->get_svg_2_norm();
+  software_renderer_imp->set_svg_2_screen( m_imp );
+
+  software_renderer_imp->redraw_dirty(*tabs.svg(current_tab));
+  present_pending = true;
+  buffer_frame = texture_frame = false;
+}
+
+void DrawSVG::regenerate_mipmap(size_t tab_index, bool keep_existing) {
+  if (tab_index < tabs.size() && tabs.svg(tab_index)) {
+    SVG* svg = tabs.svg(tab_index);
+    if (!keep_existing) prerenderer.forget(svg);
     for ( size_t i = 0; i < svg->elements.size(); ++i ) {
   
       SVGElement* element = svg->elements[i];
       if (element->type == IMAGE) {
           Texture& tex = static_cast<Image*>(element)->tex;
+          if (keep_existing && tex.mipmap.size() > 1) continue;
           sampler->generate_mips(tex, 0);
       }
     }
+    tabs.update_size(tab_index);
   }
 }
 
 void DrawSVG::auto_adjust(size_t tab_index) {
   
-  float w = tabs[tab_index]->width;
-  float h = tabs[tab_index]->height;
+  float w = tabs.svg(tab_index)->width;
+  float h = tabs.svg(tab_index)->height;
   float span = 1.2 * max(w,h) / 2;
   viewport_imp[tab_index]->set_viewbox( w / 2, h / 2, span);
   viewport_ref[tab_index]->set_viewbox( w / 2, h / 2, span);
 }
 
 
-void DrawSVG::display_pixels( const unsigned char* pixels ) const {
+unsigned char* DrawSVG::map_display_buffer() {
+
+  // a new store every frame, the gpu may still be reading the last one
+  if( !display_buffer ) glGenBuffers( 1, &display_buffer );
+  glBindBuffer( GL_PIXEL_UNPACK_BUFFER, display_buffer );
+  glBufferData( GL_PIXEL_UNPACK_BUFFER, 4 * width * height, nullptr,
+                GL_STREAM_DRAW );
+  void* pixels = glMapBuffer( GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY );
+  if( !pixels ) glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+  return static_cast<unsigned char*>( pixels );
+}
+
+void DrawSVG::update_framebuffer() {
+  if( imp_frame ) software_renderer_imp->update_render_target();
+}
 
-  // copy pixels to the screen
-  glPushAttrib( GL_VIEWPORT_BIT );
-  glViewport(0, 0, width, height);
+void DrawSVG::display_pixels( const unsigned char* pixels ) {
 
-  glMatrixMode( GL_PROJECTION );
-  glPushMatrix();
-  glLoadIdentity();
-  glOrtho( 0, width, 0, height, 0, 0 );
+  if( !width || !height ) return;
+  if( texture_frame && width == display_w && height == display_h ) {
+    draw_display_texture( true );
+    return;
+  }
 
-  glMatrixMode( GL_MODELVIEW );
-  glPushMatrix();
-  glLoadIdentity();
-  glTranslatef( -1, 1, 0 );
+  // frames the renderer did not resolve into the unpack buffer are copied
+  // there, flipped
+  if( !buffer_frame ) {
+    update_framebuffer();
+    unsigned char* upload = map_display_buffer();
+    if( upload ) {
+      size_t row = 4 * width;
+      for( size_t y = 0; y < height; ++y ) {
+        memcpy( upload + (height - 1 - y) * row, pixels + y * row, row );
+      }
+      buffer_frame = glUnmapBuffer( GL_PIXEL_UNPACK_BUFFER ) == GL_TRUE;
+      glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+    }
+  }
+
+  if( !display_texture ) {
+    glGenTextures( 1, &display_texture );
+    glBindTexture( GL_TEXTURE_2D, display_texture );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+  }
+  glBindTexture( GL_TEXTURE_2D, display_texture );
+  if( width != display_w || height != display_h ) {
+    glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0,
+                  GL_RGBA, GL_UNSIGNED_BYTE, nullptr );
+    display_w = width;
+    display_h = height;
+  }
+
+  // the gpu pulls the frame from the buffer, if it could not be mapped the
+  // pixels are uploaded top row first
+  bool bottom_up = buffer_frame;
+  if( buffer_frame ) {
+    glBindBuffer( GL_PIXEL_UNPACK_BUFFER, display_buffer );
+    glTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0, width, height,
+                     GL_RGBA, GL_UNSIGNED_BYTE, nullptr );
+    glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+  } else {
+    glTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0, width, height,
+                     GL_RGBA, GL_UNSIGNED_BYTE, pixels );
+  }
+  buffer_frame = false;
+  texture_frame = bottom_up;
+  draw_display_texture( bottom_up );
+
+}
+
+void DrawSVG::draw_display_texture( bool bottom_up ) const {
+
+  // copy pixels to the screen, a texel per pixel
+  glBindTexture( GL_TEXTURE_2D, display_texture );
+  glPushAttrib( GL_VIEWPORT_BIT | GL_ENABLE_BIT | GL_CURRENT_BIT );
+  glViewport( 0, 0, width, height );
+  glMatrixMode( GL_PROJECTION ); glPushMatrix(); glLoadIdentity(); glOrtho( 0, width, 0, height, 0.01, 1000. );
+  glMatrixMode( GL_MODELVIEW  ); glPushMatrix(); glLoadIdentity(); glTranslated( 0., 0., -1. );
 
-  glRasterPos2f(0, 0);
-  glPixelZoom( 1.0, -1.0 );
-  glDrawPixels( width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels );
-  glPixelZoom( 1.0, 1.0 );
+  float bottom_t = bottom_up ? 0 : 1, top_t = 1 - bottom_t;
+  glEnable( GL_TEXTURE_2D );
+  glDisable( GL_BLEND );
+  glDisable( GL_DEPTH_TEST );
+  glColor4f( 1, 1, 1, 1 );
+  glBegin( GL_QUADS );
+  glTexCoord2f( 0, bottom_t ); glVertex2f( 0,     0 );
+  glTexCoord2f( 1, bottom_t ); glVertex2f( width, 0 );
+  glTexCoord2f( 1, top_t );    glVertex2f( width, height );
+  glTexCoord2f( 0, top_t );    glVertex2f( 0,     height );
+  glEnd();
 
   glPopAttrib();
   glMatrixMode( GL_PROJECTION ); glPopMatrix();
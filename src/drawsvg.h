@@ -8,6 +8,9 @@
 #include "svg.h"
 #include "hardware_renderer.h"
 #include "software_renderer.h"
+#include "image_metrics.h"
+#include "tab_manager.h"
+#include "prerenderer.h"
 
 namespace CMU462 {
 
@@ -39,8 +42,22 @@ class DrawSVG : public Renderer {
     method (Software),
     sample_rate (1),
     current_tab (0),
+    previous_tab (0),
+    prerender_pending (false),
     show_diff (false),
+    diff_tolerance (0),
     show_zoom (false),
+    zoom_texture (0),
+    zoom_texture_size (0),
+    imp_frame (false),
+    redraw_pending (false),
+    present_pending (false),
+    display_texture (0),
+    display_buffer (0),
+    display_w (0),
+    display_h (0),
+    buffer_frame (false),
+    texture_frame (false),
     norm_to_screen ( Matrix3x3::identity() )  { }
 
   /**
@@ -58,6 +75,7 @@ class DrawSVG : public Renderer {
 
   void init( void );
   void render( void );
+  bool needs_render( void );
 
   void resize( size_t width, size_t height );
 
@@ -89,7 +107,7 @@ class DrawSVG : public Renderer {
         break;
     }
 
-    redraw();
+    request_redraw();
   }
 
   /** 
@@ -98,9 +116,17 @@ class DrawSVG : public Renderer {
   void drawIllustration( SVG& svg );
 
   /**
-   * Load a svg into a new tab if there is one available.
+   * Load a svg into a new tab, the tab owns it. A svg loaded from path may
+   * be released while its tab is inactive, and is loaded from there again
+   * when the tab is shown.
    */
-  void newTab( SVG* svg );
+  void newTab( SVG* svg, const std::string& path = "" );
+
+  /**
+   * Open a svg (or precompiled scene) file in a new tab, it is loaded when
+   * the tab is first shown.
+   */
+  void newTab( const std::string& path );
 
   /**
    * Delete a tab and in the renderer.
@@ -108,12 +134,34 @@ class DrawSVG : public Renderer {
   void delTab(size_t tab_index);
 
   /**
-   * Switch to a tab.
+   * Switch to a tab. A tab that fails to load is deleted. Neighboring and
+   * recently shown tabs are drawn in the background, so a tab is shown at
+   * once if its view did not change since.
    */
   void setTab(size_t tab_index);
 
   /**
-   * Get the number of pixels different from the reference.
+   * Cap the memory of the svgs kept loaded, in bytes. The svgs of inactive
+   * tabs are released, least recently shown first, to stay under it.
+   */
+  void setMemoryBudget( size_t bytes );
+
+  /**
+   * Mark an element of the current tab as changed. Call it before removing
+   * an element, and before or after changing one.
+   */
+  void markDirty( SVGElement* element );
+
+  /**
+   * Update the framebuffer after elements were marked dirty. The software
+   * renderer repaints only the damaged regions of the current frame, all
+   * other modes redraw everything.
+   */
+  void redrawDirty( void );
+
+  /**
+   * Get the number of pixels different from the reference, by more than
+   * the diff tolerance, as of the last diff drawn.
    */
   int getErrorCount( void ) const;
 
@@ -139,7 +187,7 @@ class DrawSVG : public Renderer {
 
   /* software renderer */
   SoftwareRenderer* software_renderer;
-  SoftwareRenderer* software_renderer_imp;
+  SoftwareRendererImp* software_renderer_imp;
   SoftwareRenderer* software_renderer_ref;
 
   /* texture sampler */
@@ -147,26 +195,42 @@ class DrawSVG : public Renderer {
   Sampler2D* sampler_imp;
   Sampler2D* sampler_ref;
 
-  /* tabs */
-  std::vector<SVG*> tabs; size_t current_tab;
+  /* tabs, viewports are created when a tab is first shown */
+  TabManager tabs; size_t current_tab;
   std::vector<Viewport*> viewport_imp;
   std::vector<Viewport*> viewport_ref;
+
+  /* make a tab resident, set it up and trim the others to the budget */
+  bool load_tab(size_t tab_index);
+  void trim_tabs(size_t keep);
+
+  /* frames of the tabs next to the current and the one shown before it,
+     drawn in the background by the software renderer; requested after a
+     tab switch or once the view stops changing, not on every redraw */
+  Prerenderer prerenderer; size_t previous_tab;
+  bool prerender_pending;
+  Prerenderer::View view_of(size_t tab_index) const;
+  void prerender_neighbors();
   
-  /* diff */
+  /* diff, pixels within the tolerance do not count as errors */
   bool show_diff;
+  int diff_tolerance;
+  ImageMetrics diff_metrics;
   void draw_diff();
   
-  /* zoom */
+  /* zoom, pixels is the software frame shown (nullptr for hardware) */
   bool show_zoom;
-  void draw_zoom();
+  GLuint zoom_texture; size_t zoom_texture_size;
+  std::vector<unsigned char> zoom_samples;
+  void draw_zoom( const unsigned char* pixels );
 
   /* samples rate (sqrt(s/pix)) */
   size_t sample_rate;
   void inc_sample_rate();
   void dec_sample_rate();
 
-  /* regenerate mipmap */
-  void regenerate_mipmap(size_t tab_index);
+  /* regenerate mipmap, optionally keeping precompiled mip chains */
+  void regenerate_mipmap(size_t tab_index, bool keep_existing = false);
 
   /* audo-adjust canvas_to_norm */
   void auto_adjust(size_t tab_index);
@@ -178,14 +242,45 @@ class DrawSVG : public Renderer {
   std::vector<Matrix3x3> viewport_save_imp;
   std::vector<Matrix3x3> viewport_save_ref;
 
-  /* framebuffer for software renderer */
+  /* framebuffer for software renderer (and the diff) */
   std::vector<unsigned char> framebuffer;
 
+  /* framebuffer for reference software renderer */
+  std::vector<unsigned char> reference_framebuffer;
+
+  /* framebuffer holds a plain frame of the software renderer (no diff) */
+  bool imp_frame;
+
+  /* events only request a redraw, render draws it once per frame */
+  bool redraw_pending;
+  inline void request_redraw() { redraw_pending = true; }
+
+  /* the frame is up to date but has not been shown yet */
+  bool present_pending;
+
   // update framebuffer
   void redraw();
 
+  /* software frames reach the screen through a pixel unpack buffer and a
+     texture, bottom row first */
+  GLuint display_texture, display_buffer;
+  size_t display_w, display_h;
+
+  /* the renderer resolved the frame into the unpack buffer already, the
+     texture holds the frame shown last (both reset when it changes) */
+  bool buffer_frame, texture_frame;
+
+  /* orphan, map and bind the unpack buffer (nullptr if it can not be mapped) */
+  unsigned char* map_display_buffer();
+
+  /* frames of our renderer that went to the unpack buffer only are resolved
+     into the framebuffer when it is read: the zoom loupe without samples,
+     the tab cache and copies to the screen that did not use the buffer */
+  void update_framebuffer();
+
   /* update framebuffer for software renderer */
-  void display_pixels( const unsigned char* pixels ) const;
+  void display_pixels( const unsigned char* pixels );
+  void draw_display_texture( bool bottom_up ) const;
 
 };
 
@@ -5,6 +5,7 @@
 #include <vector>
 #include <iostream>
 #include <algorithm>
+#include <cstddef>
 
 #include "triangulation.h"
 
@@ -12,6 +13,12 @@ using namespace std;
 
 namespace CMU462 {
 
+HardwareRenderer::~HardwareRenderer() {
+  release_batches();
+  if( program ) glDeleteProgram( program );
+  for( auto& entry : textures ) glDeleteTextures( 1, &entry.second.id );
+}
+
 void HardwareRenderer::resize(size_t w, size_t h) {
   context_w = w;
   context_h = h;
@@ -48,25 +55,25 @@ void HardwareRenderer::leave2DDrawing() {
 void HardwareRenderer::draw_svg( SVG& svg ) {
 
   begin2DDrawing();
-
-  // set top level transformation
-  transformation = svg_2_screen;
+  ++frame;
 
   // draw all elements
-  for ( size_t i = 0; i < svg.elements.size(); ++i ) {
-    draw_element(svg.elements[i]);
-  }
+  draw_batch( batch(svg) );
 
-  // draw canvas outline
+  // draw canvas outline (in screen space)
+  transformation = svg_2_screen;
   Vector2D a = transform(Vector2D(    0    ,     0    )); a.x--; a.y--;
   Vector2D b = transform(Vector2D(svg.width,     0    )); b.x++; b.y--;
   Vector2D c = transform(Vector2D(    0    ,svg.height)); c.x--; c.y++;
   Vector2D d = transform(Vector2D(svg.width,svg.height)); d.x++; d.y++;
 
-  rasterize_line(a.x, a.y, b.x, b.y, Color::Black);
-  rasterize_line(a.x, a.y, c.x, c.y, Color::Black);
-  rasterize_line(d.x, d.y, b.x, b.y, Color::Black);
-  rasterize_line(d.x, d.y, c.x, c.y, Color::Black);
+  glColor4f(0, 0, 0, 1);
+  glBegin(GL_LINES);
+  glVertex2f(a.x, a.y); glVertex2f(b.x, b.y);
+  glVertex2f(a.x, a.y); glVertex2f(c.x, c.y);
+  glVertex2f(d.x, d.y); glVertex2f(b.x, b.y);
+  glVertex2f(d.x, d.y); glVertex2f(c.x, c.y);
+  glEnd();
 
   // resolve and send to render target
   // resolve();
@@ -141,9 +148,11 @@ void HardwareRenderer::draw_polyline( Polyline& polyline ) {
 
   if( c.a != 0 ) {
     int nPoints = polyline.points.size();
+    vector<Vector2D> points( nPoints );
+    transform( transformation, polyline.points.data(), points.data(), nPoints );
     for( int i = 0; i < nPoints - 1; i++ ) {
-      Vector2D p0 = transform(polyline.points[(i+0) % nPoints]);
-      Vector2D p1 = transform(polyline.points[(i+1) % nPoints]);
+      Vector2D p0 = points[(i+0) % nPoints];
+      Vector2D p1 = points[(i+1) % nPoints];
       rasterize_line( p0.x, p0.y, p1.x, p1.y, c );
     }
   }
@@ -207,9 +216,11 @@ void HardwareRenderer::draw_polygon( Polygon& polygon ) {
   c = polygon.style.strokeColor;
   if( c.a != 0 ) {
     int nPoints = polygon.points.size();
+    vector<Vector2D> points( nPoints );
+    transform( transformation, polygon.points.data(), points.data(), nPoints );
     for( int i = 0; i < nPoints; i++ ) {
-      Vector2D p0 = transform(polygon.points[(i+0) % nPoints]);
-      Vector2D p1 = transform(polygon.points[(i+1) % nPoints]);
+      Vector2D p0 = points[(i+0) % nPoints];
+      Vector2D p1 = points[(i+1) % nPoints];
       rasterize_line( p0.x, p0.y, p1.x, p1.y, c );
     }
   }
@@ -245,10 +256,15 @@ void HardwareRenderer::rasterize_point(float x, float y, Color color) {
 
   // Task 1: 
   // Implement point rasterization
-  glColor4f(color.r,color.g,color.b,color.a);
-  glBegin(GL_POINTS);
-  glVertex2f(x,y);
-  glEnd();
+  if( !expand_primitives ) {
+    add_index(GL_POINTS, add_vertex(x, y, x, y, 0, 0, color));
+    return;
+  }
+  GLuint v = add_vertex(x, y, x, y, -.5f, -.5f, color);
+  add_vertex(x, y, x, y,  .5f, -.5f, color);
+  add_vertex(x, y, x, y,  .5f,  .5f, color);
+  add_vertex(x, y, x, y, -.5f,  .5f, color);
+  add_quad(v);
 
 }
 
@@ -258,11 +274,17 @@ void HardwareRenderer::rasterize_line(float x0, float y0,
 
   // Task 1: 
   // Implement line rasterization
-  glColor4f(color.r,color.g,color.b,color.a);
-  glBegin(GL_LINES);
-  glVertex2f(x0,y0);
-  glVertex2f(x1,y1);
-  glEnd();
+  if( x0 == x1 && y0 == y1 ) return;
+  if( !expand_primitives ) {
+    add_index(GL_LINES, add_vertex(x0, y0, x0, y0, 0, 0, color));
+    add_index(GL_LINES, add_vertex(x1, y1, x1, y1, 0, 0, color));
+    return;
+  }
+  GLuint v = add_vertex(x0, y0, x1, y1, -.5f, 0, color);
+  add_vertex(x1, y1, x0, y0, -.5f, 0, color);
+  add_vertex(x1, y1, x0, y0,  .5f, 0, color);
+  add_vertex(x0, y0, x1, y1,  .5f, 0, color);
+  add_quad(v);
 
 }
 
@@ -272,23 +294,333 @@ void HardwareRenderer::rasterize_triangle(float x0, float y0,
                                           Color color) {
   // Task 1: 
   // Implement triangle rasterization
-  glColor4f(color.r,color.g,color.b,color.a);
-  glVertex2f(x0,y0);
-  glVertex2f(x1,y1);
-  glVertex2f(x2,y2);
-  glEnd();
+
+  // any svg to screen transformation keeps collinear points collinear, so
+  // degenerate triangles never cover a pixel
+  if( (x1 - x0) * (y2 - y0) == (x2 - x0) * (y1 - y0) ) return;
+  GLuint v = add_vertex(x0, y0, x0, y0, 0, 0, color);
+  add_vertex(x1, y1, x1, y1, 0, 0, color);
+  add_vertex(x2, y2, x2, y2, 0, 0, color);
+  add_triangle(v, v + 1, v + 2);
 
 }
 
 void HardwareRenderer::rasterize_image(float x0, float y0,
                                        float x1, float y1,
                                        Texture& tex) {
+
+  BatchRun run = { GL_QUADS, indices.size(), 0, &tex, x0, y0, x1, y1 };
+  building->runs.push_back(run);
+
+}
+
+void HardwareRenderer::draw_image_quad(float x0, float y0,
+                                       float x1, float y1,
+                                       Texture& tex) {
+  if( tex.mipmap.empty() ) return;
+
   glColor4f(1, 1, 1, 1);
+  bind_texture(tex);
+
+  // enable texture and draw
+  glEnable(GL_TEXTURE_2D);
+
+  glBegin(GL_QUADS);
+  glTexCoord2f(0.0, 1.0); glVertex2f( x0, y1 );
+  glTexCoord2f(1.0, 1.0); glVertex2f( x1, y1 );
+  glTexCoord2f(1.0, 0.0); glVertex2f( x1, y0 );
+  glTexCoord2f(0.0, 0.0); glVertex2f( x0, y0 );
+  glEnd();
+
+  glDisable(GL_TEXTURE_2D);
+
+  return;
+}
+
+
+// Batching //
+
+
+namespace {
+
+const char* kVertexShader =
+  "#version 120\n"
+  "uniform mat3 svg_2_screen;\n"
+  "uniform vec2 screen_size;\n"
+  "attribute vec2 position;\n"
+  "attribute vec2 line_end;\n"
+  "attribute vec2 offset;\n"
+  "attribute vec4 color;\n"
+  "varying vec4 fill;\n"
+  "vec2 to_screen(vec2 p) {\n"
+  "  vec3 q = svg_2_screen * vec3(p, 1.0);\n"
+  "  return q.xy / q.z;\n"
+  "}\n"
+  "void main() {\n"
+  "  vec2 p = to_screen(position);\n"
+  "  if (line_end != position) {\n"
+  "    // lines are parallelograms one pixel wide along the minor axis,\n"
+  "    // as GL rasterizes aliased lines\n"
+  "    vec2 d = to_screen(line_end) - p;\n"
+  "    p += abs(d.x) >= abs(d.y) ? vec2(0.0, offset.x) : vec2(offset.x, 0.0);\n"
+  "  } else {\n"
+  "    p += offset;\n"
+  "  }\n"
+  "  gl_Position = vec4(2.0 * p.x / screen_size.x - 1.0,\n"
+  "                     1.0 - 2.0 * p.y / screen_size.y, 0.0, 1.0);\n"
+  "  fill = color;\n"
+  "}\n";
+
+const char* kFragmentShader =
+  "#version 120\n"
+  "varying vec4 fill;\n"
+  "void main() {\n"
+  "  gl_FragColor = fill;\n"
+  "}\n";
+
+enum { POSITION, LINE_END, OFFSET, COLOR };
+
+// draw calls per batch before points and lines are expanded to triangles
+const size_t kMaxBatchRuns = 16;
+
+GLuint compile_shader( GLenum type, const char* source ) {
+
+  GLuint shader = glCreateShader(type);
+  glShaderSource(shader, 1, &source, nullptr);
+  glCompileShader(shader);
+
+  GLint status;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+  if( !status ) {
+    char log[1024];
+    glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+    cerr << "HardwareRenderer: shader compilation failed: " << log << endl;
+    glDeleteShader(shader);
+    return 0;
+  }
+  return shader;
+}
+
+} // namespace
+
+bool HardwareRenderer::load_program() {
+
+  if( program ) return true;
+  if( program_failed ) return false;
+  program_failed = true;
+
+  GLuint vertex = compile_shader(GL_VERTEX_SHADER, kVertexShader);
+  GLuint fragment = compile_shader(GL_FRAGMENT_SHADER, kFragmentShader);
+  if( !vertex || !fragment ) {
+    glDeleteShader(vertex);
+    glDeleteShader(fragment);
+    return false;
+  }
+
+  GLuint linked = glCreateProgram();
+  glAttachShader(linked, vertex);
+  glAttachShader(linked, fragment);
+  glBindAttribLocation(linked, POSITION, "position");
+  glBindAttribLocation(linked, LINE_END, "line_end");
+  glBindAttribLocation(linked, OFFSET, "offset");
+  glBindAttribLocation(linked, COLOR, "color");
+  glLinkProgram(linked);
+  glDeleteShader(vertex);
+  glDeleteShader(fragment);
+
+  GLint status;
+  glGetProgramiv(linked, GL_LINK_STATUS, &status);
+  if( !status ) {
+    char log[1024];
+    glGetProgramInfoLog(linked, sizeof(log), nullptr, log);
+    cerr << "HardwareRenderer: shader linking failed: " << log << endl;
+    glDeleteProgram(linked);
+    return false;
+  }
+
+  program = linked;
+  program_failed = false;
+  svg_2_screen_uniform = glGetUniformLocation(program, "svg_2_screen");
+  screen_size_uniform = glGetUniformLocation(program, "screen_size");
+  return true;
+}
+
+HardwareRenderer::Batch& HardwareRenderer::batch( SVG& svg ) {
+
+  auto it = batches.find(&svg);
+  if( it != batches.end() ) return it->second;
+
+  // record every element in svg coordinates. Points and lines are kept as
+  // they are unless they interleave with triangles so much that paint order
+  // splits the batch into many draw calls, then everything is drawn as
+  // triangles
+  Batch& batch = batches[&svg];
+  building = &batch;
+  for( int pass = 0; pass < 2; ++pass ) {
+    expand_primitives = pass == 1;
+    batch.runs.clear();
+    vertices.clear();
+    indices.clear();
+    transformation = Matrix3x3::identity();
+    for ( size_t i = 0; i < svg.elements.size(); ++i ) {
+      draw_element(svg.elements[i]);
+    }
+    if( batch.runs.size() <= kMaxBatchRuns ) break;
+  }
+  building = nullptr;
+
+  glGenBuffers(1, &batch.vertex_buffer);
+  glBindBuffer(GL_ARRAY_BUFFER, batch.vertex_buffer);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(BatchVertex),
+               vertices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glGenBuffers(1, &batch.index_buffer);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch.index_buffer);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint),
+               indices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  vector<BatchVertex>().swap(vertices);
+  vector<GLuint>().swap(indices);
+
+  return batch;
+}
+
+GLuint HardwareRenderer::add_vertex( float x, float y, float end_x, float end_y,
+                                     float offset_x, float offset_y,
+                                     const Color& color ) {
+
+  BatchVertex v = { x, y, end_x, end_y, offset_x, offset_y, {} };
+  float rgba[4] = { color.r, color.g, color.b, color.a };
+  for( int i = 0; i < 4; ++i ) {
+    v.color[i] = (unsigned char) (min(max(rgba[i], 0.0f), 1.0f) * 255 + 0.5f);
+  }
+  vertices.push_back(v);
+  return GLuint(vertices.size() - 1);
+}
+
+void HardwareRenderer::add_index( GLenum mode, GLuint index ) {
+
+  // extend the last run if it draws the same primitives
+  vector<BatchRun>& runs = building->runs;
+  if( runs.empty() || runs.back().mode != mode ) {
+    BatchRun run = { mode, indices.size(), 0, nullptr, 0, 0, 0, 0 };
+    runs.push_back(run);
+  }
+  runs.back().count++;
+  indices.push_back(index);
+}
+
+void HardwareRenderer::add_triangle( GLuint a, GLuint b, GLuint c ) {
+  add_index(GL_TRIANGLES, a);
+  add_index(GL_TRIANGLES, b);
+  add_index(GL_TRIANGLES, c);
+}
+
+void HardwareRenderer::add_quad( GLuint first ) {
+  add_triangle(first, first + 1, first + 2);
+  add_triangle(first, first + 2, first + 3);
+}
+
+void HardwareRenderer::draw_batch( const Batch& batch ) {
+
+  if( !load_program() ) return;
+
+  // svg to screen, column major
+  const Matrix3x3& m = svg_2_screen;
+  GLfloat matrix[9] = {
+    (float) m(0,0), (float) m(1,0), (float) m(2,0),
+    (float) m(0,1), (float) m(1,1), (float) m(2,1),
+    (float) m(0,2), (float) m(1,2), (float) m(2,2)
+  };
+  glUseProgram(program);
+  glUniformMatrix3fv(svg_2_screen_uniform, 1, GL_FALSE,
+                     matrix);
+  glUniform2f(screen_size_uniform, context_w, context_h);
+
+  glBindBuffer(GL_ARRAY_BUFFER, batch.vertex_buffer);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch.index_buffer);
+  GLsizei stride = sizeof(BatchVertex);
+  glVertexAttribPointer(POSITION, 2, GL_FLOAT, GL_FALSE, stride,
+                        (const GLvoid*) offsetof(BatchVertex, x));
+  glVertexAttribPointer(LINE_END, 2, GL_FLOAT, GL_FALSE, stride,
+                        (const GLvoid*) offsetof(BatchVertex, end_x));
+  glVertexAttribPointer(OFFSET, 2, GL_FLOAT, GL_FALSE, stride,
+                        (const GLvoid*) offsetof(BatchVertex, offset_x));
+  glVertexAttribPointer(COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride,
+                        (const GLvoid*) offsetof(BatchVertex, color));
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  transformation = svg_2_screen;
+  for( const BatchRun& run : batch.runs ) {
+    if( !run.tex ) {
+      for( GLuint i = POSITION; i <= COLOR; ++i ) glEnableVertexAttribArray(i);
+      glDrawElements(run.mode, run.count, GL_UNSIGNED_INT,
+                     (const GLvoid*) (run.first * sizeof(GLuint)));
+      for( GLuint i = POSITION; i <= COLOR; ++i ) glDisableVertexAttribArray(i);
+      continue;
+    }
+
+    // images go through the fixed function pipeline, in screen space
+    glUseProgram(0);
+    Vector2D p0 = transform(Vector2D(run.x0, run.y0));
+    Vector2D p1 = transform(Vector2D(run.x1, run.y1));
+    draw_image_quad(p0.x, p0.y, p1.x, p1.y, *run.tex);
+    glUseProgram(program);
+  }
+
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  glUseProgram(0);
+}
+
+void HardwareRenderer::mark_dirty( SVG& svg, SVGElement* element ) {
+  release_batch(&svg);
+}
+
+void HardwareRenderer::release_batch( const SVG* svg ) {
+  auto it = batches.find(svg);
+  if( it == batches.end() ) return;
+  glDeleteBuffers(1, &it->second.vertex_buffer);
+  glDeleteBuffers(1, &it->second.index_buffer);
+  batches.erase(it);
+}
+
+void HardwareRenderer::release_batches() {
+  for( auto& entry : batches ) {
+    glDeleteBuffers(1, &entry.second.vertex_buffer);
+    glDeleteBuffers(1, &entry.second.index_buffer);
+  }
+  batches.clear();
+}
+
+
+// Texture Cache //
+
+
+void HardwareRenderer::bind_texture( Texture& tex ) {
 
   size_t w = tex.mipmap[0].width;
   size_t h = tex.mipmap[0].height;
   unsigned char* texels = &tex.mipmap[0].texels[0];
 
+  // a texture whose level 0 was replaced (or a new one at the address of
+  // a deleted one) has to be uploaded again
+  auto it = textures.find(&tex);
+  if( it != textures.end() && ( it->second.texels != texels ||
+      it->second.width != w || it->second.height != h ) ) {
+    release_texture(&tex);
+    it = textures.end();
+  }
+
+  if( it != textures.end() ) {
+    glBindTexture(GL_TEXTURE_2D, it->second.id);
+    it->second.last_use = frame;
+    return;
+  }
+
+  // level 0 and a third more for the mip chain
+  size_t bytes = 4 * w * h * 4 / 3;
+  evict_textures(bytes);
+
   GLuint texid;
   glGenTextures(1, &texid);
 
@@ -304,19 +636,56 @@ void HardwareRenderer::rasterize_image(float x0, float y0,
                               0, GL_RGBA, GL_UNSIGNED_BYTE, texels);
   glGenerateMipmap(GL_TEXTURE_2D);
 
-  // enable texture and draw
-  glEnable(GL_TEXTURE_2D);
+  CachedTexture cached = { texid, texels, w, h, bytes, frame };
+  textures[&tex] = cached;
+  texture_bytes += bytes;
+}
 
-  glBegin(GL_QUADS);
-  glTexCoord2f(0.0, 1.0); glVertex2f( x0, y1 );
-  glTexCoord2f(1.0, 1.0); glVertex2f( x1, y1 );
-  glTexCoord2f(1.0, 0.0); glVertex2f( x1, y0 );
-  glTexCoord2f(0.0, 0.0); glVertex2f( x0, y0 );
-  glEnd();
+void HardwareRenderer::release_texture( const Texture* tex ) {
 
-  glDisable(GL_TEXTURE_2D);
+  auto it = textures.find(tex);
+  if( it == textures.end() ) return;
+  glDeleteTextures(1, &it->second.id);
+  texture_bytes -= it->second.bytes;
+  textures.erase(it);
+}
 
-  return;
+void HardwareRenderer::evict_textures( size_t incoming ) {
+
+  // least recently drawn first, textures of the current frame stay even if
+  // the frame alone is over budget
+  while( texture_bytes + incoming > texture_budget ) {
+    auto lru = textures.end();
+    for( auto it = textures.begin(); it != textures.end(); ++it ) {
+      if( it->second.last_use == frame ) continue;
+      if( lru == textures.end() || it->second.last_use < lru->second.last_use )
+        lru = it;
+    }
+    if( lru == textures.end() ) return;
+    release_texture(lru->first);
+  }
+}
+
+void HardwareRenderer::set_texture_budget( size_t bytes ) {
+  texture_budget = bytes;
+  evict_textures(0);
+}
+
+void HardwareRenderer::forget_svg( SVG& svg ) {
+
+  release_batch(&svg);
+  forget_textures(svg.elements);
+}
+
+void HardwareRenderer::forget_textures( vector<SVGElement*>& elements ) {
+
+  for( SVGElement* element : elements ) {
+    if( element->type == IMAGE ) {
+      release_texture(&static_cast<Image*>(element)->tex);
+    } else if( element->type == GROUP ) {
+      forget_textures(static_cast<Group*>(element)->elements);
+    }
+  }
 }
 
 } // namespace CMU462
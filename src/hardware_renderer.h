@@ -2,6 +2,8 @@
 #define CMU462_HARDWARE_RENDERER_H
 
 #include <stdio.h>
+#include <vector>
+#include <unordered_map>
 
 #include "CMU462.h"
 #include "svg_renderer.h"
@@ -12,10 +14,14 @@ namespace CMU462 {
 class HardwareRenderer : public SVGRenderer {
  public:
 
-  HardwareRenderer() { glClearColor(1,1,1,1); }
+  HardwareRenderer() :
+    building( nullptr ), expand_primitives( false ), program( 0 ), program_failed( false ),
+    texture_bytes( 0 ), texture_budget( 256 << 20 ), frame( 0 ) {
+    glClearColor(1,1,1,1);
+  }
 
   // Implements Renderer
-  ~HardwareRenderer() { }
+  ~HardwareRenderer();
 
   // 2D drawing mode
   void begin2DDrawing();
@@ -37,6 +43,19 @@ class HardwareRenderer : public SVGRenderer {
     this->svg_2_screen = svg_2_screen;
   }
 
+  // drop the vertex buffer of svg after element (one of its elements) was
+  // edited, edited elements must be marked before the next draw of svg;
+  // the buffers of other documents are kept
+  void mark_dirty( SVG& svg, SVGElement* element );
+
+  // release the vertex buffer and GL textures of svg, call it before
+  // deleting one
+  void forget_svg( SVG& svg );
+
+  // GPU memory the texture cache may hold (256MB by default), the least
+  // recently drawn textures are released beyond it
+  void set_texture_budget( size_t bytes );
+
  private:
 
   // Primitive Drawing //
@@ -69,6 +88,7 @@ class HardwareRenderer : public SVGRenderer {
   void draw_group( Group& group );
 
   // Rasterization //
+  // primitives are recorded into the batch being built, in svg coordinates
 
   // rasterize a point
   void rasterize_point( float x, float y, Color color );
@@ -89,6 +109,64 @@ class HardwareRenderer : public SVGRenderer {
                         float x1, float y1,
                         Texture& tex );
 
+  // draw a textured quad in screen space
+  void draw_image_quad( float x0, float y0,
+                        float x1, float y1,
+                        Texture& tex );
+
+  // Batching //
+  // every document is drawn from one vertex buffer built on its first draw,
+  // pan and zoom only change the transformation uniform. Consecutive
+  // primitives of a kind go out in one draw call; if paint order would need
+  // too many, points and lines are expanded into triangles (by the vertex
+  // shader, one pixel wide in screen space) so that everything between two
+  // images is a single draw call
+
+  struct BatchVertex {
+    float x, y;
+    float end_x, end_y;          // other end of a line, the vertex otherwise
+    float offset_x, offset_y;    // in pixels, lines only use offset_x
+    unsigned char color[4];
+  };
+
+  // a range of indices drawn as one kind of primitive, or a single image
+  struct BatchRun {
+    GLenum mode;
+    size_t first;
+    GLsizei count;
+    Texture* tex;
+    float x0, y0, x1, y1;
+  };
+
+  struct Batch {
+    GLuint vertex_buffer, index_buffer;
+    std::vector<BatchRun> runs;
+  };
+
+  std::unordered_map<const SVG*, Batch> batches;
+
+  // vertices and indices of the batch being built
+  Batch* building;
+  bool expand_primitives;
+  std::vector<BatchVertex> vertices;
+  std::vector<GLuint> indices;
+
+  // shader program and its uniforms
+  GLuint program;
+  GLint svg_2_screen_uniform, screen_size_uniform;
+  bool program_failed;
+
+  Batch& batch( SVG& svg );
+  GLuint add_vertex( float x, float y, float end_x, float end_y,
+                     float offset_x, float offset_y, const Color& color );
+  void add_index( GLenum mode, GLuint index );
+  void add_triangle( GLuint a, GLuint b, GLuint c );
+  void add_quad( GLuint first );
+  void draw_batch( const Batch& batch );
+  void release_batch( const SVG* svg );
+  void release_batches();
+  bool load_program();
+
   // resolve samples to render target
   // void resolve( void );
 
@@ -97,6 +175,25 @@ class HardwareRenderer : public SVGRenderer {
 
   // SVG coordinates to screen space coordinates
   Matrix3x3 svg_2_screen;
+
+  // texture cache: images are uploaded (with their mipmaps) on first draw
+  // and rebound afterwards, keyed by the Texture they came from
+  struct CachedTexture {
+    GLuint id;
+    const unsigned char* texels; // level 0 the texture was uploaded from
+    size_t width, height;
+    size_t bytes;
+    size_t last_use;             // frame the texture was last drawn in
+  };
+  std::unordered_map<const Texture*, CachedTexture> textures;
+  size_t texture_bytes, texture_budget;
+  size_t frame;
+
+  // bind the GL texture of tex, uploading it if needed
+  void bind_texture( Texture& tex );
+  void release_texture( const Texture* tex );
+  void evict_textures( size_t incoming );
+  void forget_textures( std::vector<SVGElement*>& elements );
     
 }; // class HardwareRenderer
 
@@ -0,0 +1,240 @@
+#include "image_metrics.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define DRAWSVG_SSE2
+#endif
+
+using namespace std;
+
+namespace CMU462 {
+
+namespace {
+
+// ssim window size and stabilizing constants for 8-bit data
+const size_t kWindow = 8;
+const double kC1 = (0.01 * 255) * (0.01 * 255);
+const double kC2 = (0.03 * 255) * (0.03 * 255);
+
+// running totals of the per channel differences
+struct ErrorSums {
+  int max_error = 0;
+  uint64_t sum = 0, sum_squares = 0;
+  size_t error_count = 0;
+};
+
+// Rec. 601 luma in 8.8 fixed point
+inline int16_t luma( const unsigned char* p ) {
+  return (77 * p[0] + 150 * p[1] + 29 * p[2] + 128) >> 8;
+}
+
+double ssim( double n, double sa, double sb,
+             double saa, double sbb, double sab ) {
+
+  double ma = sa / n, mb = sb / n;
+  double va = saa / n - ma * ma, vb = sbb / n - mb * mb;
+  double cov = sab / n - ma * mb;
+  return ((2 * ma * mb + kC1) * (2 * cov + kC2)) /
+         ((ma * ma + mb * mb + kC1) * (va + vb + kC2));
+}
+
+// sum of ssim times window size over a band of rows rows of luma
+double band_ssim( const int16_t* la, const int16_t* lb,
+                  size_t width, size_t rows ) {
+
+  double total = 0;
+  size_t x = 0;
+
+#ifdef DRAWSVG_SSE2
+  // full windows, a row of the window per register
+  if( rows == kWindow ) {
+    const __m128i ones = _mm_set1_epi16( 1 );
+    auto sum32 = []( __m128i v ) {
+      v = _mm_add_epi32( v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)) );
+      v = _mm_add_epi32( v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)) );
+      return _mm_cvtsi128_si32( v );
+    };
+    for( ; x + kWindow <= width; x += kWindow ) {
+      __m128i sa = _mm_setzero_si128(), sb = sa;
+      __m128i saa = sa, sbb = sa, sab = sa;
+      for( size_t y = 0; y < kWindow; ++y ) {
+        __m128i va = _mm_loadu_si128( (const __m128i*) (la + y * width + x) );
+        __m128i vb = _mm_loadu_si128( (const __m128i*) (lb + y * width + x) );
+        sa = _mm_add_epi16( sa, va );
+        sb = _mm_add_epi16( sb, vb );
+        saa = _mm_add_epi32( saa, _mm_madd_epi16(va, va) );
+        sbb = _mm_add_epi32( sbb, _mm_madd_epi16(vb, vb) );
+        sab = _mm_add_epi32( sab, _mm_madd_epi16(va, vb) );
+      }
+      total += kWindow * kWindow *
+               ssim( kWindow * kWindow,
+                     sum32(_mm_madd_epi16(sa, ones)),
+                     sum32(_mm_madd_epi16(sb, ones)),
+                     sum32(saa), sum32(sbb), sum32(sab) );
+    }
+  }
+#endif
+
+  // partial windows at the right and bottom edges
+  for( ; x < width; x += kWindow ) {
+    size_t w = min( kWindow, width - x );
+    double sa = 0, sb = 0, saa = 0, sbb = 0, sab = 0;
+    for( size_t y = 0; y < rows; ++y ) {
+      for( size_t i = x; i < x + w; ++i ) {
+        double va = la[y * width + i], vb = lb[y * width + i];
+        sa += va; sb += vb;
+        saa += va * va; sbb += vb * vb; sab += va * vb;
+      }
+    }
+    total += w * rows * ssim( w * rows, sa, sb, saa, sbb, sab );
+  }
+
+  return total;
+}
+
+// accumulate the differences of count pixels and take their luma in the
+// same pass, writing the diff if asked
+void error_row( const unsigned char* a, const unsigned char* b,
+                unsigned char* diff, size_t count, int tolerance,
+                int16_t* la, int16_t* lb, ErrorSums& sums ) {
+
+  size_t i = 0;
+
+#ifdef DRAWSVG_SSE2
+  // luma: r and b sit in the 16-bit halves of each pixel and g goes on its
+  // own, one madd weights each pair
+  const __m128i low_bytes = _mm_set1_epi32( 0x00ff00ff );
+  const __m128i weights_rb = _mm_setr_epi16( 77, 29, 77, 29, 77, 29, 77, 29 );
+  const __m128i weights_g = _mm_setr_epi16( 150, 0, 150, 0, 150, 0, 150, 0 );
+  const __m128i half = _mm_set1_epi32( 128 );
+  auto luma4 = [&]( __m128i p, int16_t* out ) {
+    __m128i rb = _mm_and_si128( p, low_bytes );
+    __m128i g = _mm_and_si128( _mm_srli_epi32(p, 8), low_bytes );
+    __m128i y = _mm_add_epi32( _mm_madd_epi16(rb, weights_rb),
+                               _mm_madd_epi16(g, weights_g) );
+    y = _mm_srli_epi32( _mm_add_epi32(y, half), 8 );
+    _mm_storel_epi64( (__m128i*) out, _mm_packs_epi32(y, y) );
+  };
+
+  // four pixels per register
+  static const int zero_lanes[16] = {
+    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4
+  };
+  const __m128i alpha = _mm_set1_epi32( (int) 0xff000000 );
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i tol = _mm_set1_epi8( (char) tolerance );
+  __m128i max_error = zero, sum = zero;
+  size_t within = 0;
+  while( i + 4 <= count ) {
+
+    // squares are summed in 32 bits, flush them before they can overflow
+    __m128i squares = zero;
+    size_t end = min( count - count % 4, i + 4 * 4096 );
+    for( ; i < end; i += 4 ) {
+      __m128i va = _mm_loadu_si128( (const __m128i*) (a + 4 * i) );
+      __m128i vb = _mm_loadu_si128( (const __m128i*) (b + 4 * i) );
+      luma4( va, la + i );
+      luma4( vb, lb + i );
+      __m128i d = _mm_or_si128( _mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va) );
+      d = _mm_andnot_si128( alpha, d );
+      max_error = _mm_max_epu8( max_error, d );
+      sum = _mm_add_epi64( sum, _mm_sad_epu8(d, zero) );
+      __m128i lo = _mm_unpacklo_epi8( d, zero );
+      __m128i hi = _mm_unpackhi_epi8( d, zero );
+      squares = _mm_add_epi32( squares, _mm_add_epi32( _mm_madd_epi16(lo, lo),
+                                                       _mm_madd_epi16(hi, hi) ) );
+      __m128i over = _mm_subs_epu8( d, tol );
+      __m128i ok = _mm_cmpeq_epi32( over, zero );
+      within += zero_lanes[ _mm_movemask_ps( _mm_castsi128_ps(ok) ) ];
+      if( diff ) {
+        _mm_storeu_si128( (__m128i*) (diff + 4 * i), _mm_or_si128(d, alpha) );
+      }
+    }
+
+    uint32_t s[4];
+    _mm_storeu_si128( (__m128i*) s, squares );
+    sums.sum_squares += (uint64_t) s[0] + s[1] + s[2] + s[3];
+  }
+
+  unsigned char m[16];
+  _mm_storeu_si128( (__m128i*) m, max_error );
+  sums.max_error = max( sums.max_error, (int) *max_element(m, m + 16) );
+  uint64_t t[2];
+  _mm_storeu_si128( (__m128i*) t, sum );
+  sums.sum += t[0] + t[1];
+  sums.error_count += i - within;
+#endif
+
+  for( ; i < count; ++i ) {
+    la[i] = luma( a + 4 * i );
+    lb[i] = luma( b + 4 * i );
+    bool over = false;
+    for( int k = 0; k < 3; ++k ) {
+      int d = abs( a[4 * i + k] - b[4 * i + k] );
+      sums.max_error = max( sums.max_error, d );
+      sums.sum += d;
+      sums.sum_squares += d * d;
+      over |= d > tolerance;
+      if( diff ) diff[4 * i + k] = d;
+    }
+    if( diff ) diff[4 * i + 3] = 255;
+    sums.error_count += over;
+  }
+}
+
+} // namespace
+
+string ImageMetrics::summary() const {
+
+  ostringstream out;
+  out << error_count << " pixels different";
+  if( tolerance ) out << " (> " << tolerance << ")";
+  out << fixed << setprecision(2)
+      << ", max " << max_error << ", mean " << mean_error << ", PSNR ";
+  if( isinf(psnr) ) out << "inf"; else out << psnr;
+  out << " dB, SSIM " << setprecision(4) << ssim;
+  return out.str();
+}
+
+ImageMetrics compare_images( const unsigned char* a, const unsigned char* b,
+                             size_t width, size_t height, int tolerance,
+                             unsigned char* diff ) {
+
+  ImageMetrics metrics;
+  tolerance = max( 0, min(tolerance, 255) );
+  metrics.tolerance = tolerance;
+  size_t pixels = width * height;
+  if( !pixels ) return metrics;
+
+  // a band of windows at a time, its luma is taken before the diff
+  // overwrites a or b and the windows are scored while it is in cache
+  vector<int16_t> la( kWindow * width ), lb( kWindow * width );
+  ErrorSums sums;
+  double ssim_total = 0;
+  for( size_t y = 0; y < height; y += kWindow ) {
+    size_t rows = min( kWindow, height - y );
+    size_t offset = 4 * y * width;
+    error_row( a + offset, b + offset, diff ? diff + offset : nullptr,
+               rows * width, tolerance, &la[0], &lb[0], sums );
+    ssim_total += band_ssim( &la[0], &lb[0], width, rows );
+  }
+
+  double samples = 3.0 * pixels;
+  double mse = sums.sum_squares / samples;
+  metrics.max_error = sums.max_error;
+  metrics.mean_error = sums.sum / samples;
+  metrics.psnr = mse > 0 ? 10 * log10(255 * 255 / mse) : INFINITY;
+  metrics.ssim = ssim_total / pixels;
+  metrics.error_count = sums.error_count;
+  return metrics;
+}
+
+} // namespace CMU462
@@ -0,0 +1,45 @@
+#ifndef CMU462_IMAGE_METRICS_H
+#define CMU462_IMAGE_METRICS_H
+
+#include <string>
+#include <cstddef>
+
+namespace CMU462 {
+
+/**
+ * Differences between two images, over the color channels only.
+ */
+struct ImageMetrics {
+
+  // largest and mean absolute difference of a channel, 0 - 255
+  int max_error = 0;
+  double mean_error = 0;
+
+  // peak signal to noise ratio in dB, infinite for identical images
+  double psnr = 0;
+
+  // structural similarity of the luma, mean over 8x8 windows, 1 if identical
+  double ssim = 1;
+
+  // pixels with a channel differing by more than the tolerance
+  size_t error_count = 0;
+  int tolerance = 0;
+
+  // one line summary, for the osd and the command line
+  std::string summary() const;
+
+}; // struct ImageMetrics
+
+/**
+ * Compare two RGBA images of width x height pixels, top row first, alpha is
+ * ignored. If diff is given it receives the absolute difference per channel
+ * with opaque alpha, diff may be a or b itself. All metrics come out of a
+ * single pass over bands of 8 rows, vectorized with SSE2 where available.
+ */
+ImageMetrics compare_images( const unsigned char* a, const unsigned char* b,
+                             size_t width, size_t height, int tolerance = 0,
+                             unsigned char* diff = nullptr );
+
+} // namespace CMU462
+
+#endif // CMU462_IMAGE_METRICS_H
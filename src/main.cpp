@@ -1,10 +1,17 @@
 #include "CMU462.h"
 #include "viewer.h"
 #include "drawsvg.h"
+#include "svg_binary.h"
+#include "offscreen_renderer.h"
+#include "image_metrics.h"
+#include "png.h"
 
 #include <sys/stat.h>
 #include <dirent.h>
 #include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
 
 using namespace std;
 using namespace CMU462;
@@ -15,12 +22,14 @@ int loadFile( DrawSVG* drawsvg, const char* path ) {
 
   SVG* svg = new SVG();
 
-  if( SVGParser::load( path, svg ) < 0) {
+  // precompiled scenes (also one compiled from a svg given) skip xml
+  // parsing and mipmap generation
+  if( SVGBinaryParser::load_file( path, svg ) < 0) {
     delete svg;
     return -1;
   }
   
-  drawsvg->newTab( svg );
+  drawsvg->newTab( svg, path );
   return 0;
 }
 
@@ -29,30 +38,44 @@ int loadDirectory( DrawSVG* drawsvg, const char* path ) {
   DIR *dir = opendir (path);
   if(dir) {
     
-    struct dirent *ent; size_t n = 0;
+    struct dirent *ent;
+    vector<string> filenames;
     
-    // load files
+    // list files, in order
     string pathname = path; 
-    if (pathname[pathname.back()] != '/') pathname.push_back('/');
-    while (((ent = readdir (dir)) != NULL) && (n < 9)) {
+    if (pathname.back() != '/') pathname.push_back('/');
+    while ((ent = readdir (dir)) != NULL) {
 
       string filename = ent->d_name;
       string filesufx = filename.substr(filename.find_last_of(".") + 1);
-      if (filesufx == "svg" ) {
-        cerr << "[DrawSVG] Loading " << filename << "... "; 
-        if (loadFile(drawsvg, (pathname + filename).c_str()) < 0) {
-          cerr << "Failed (Invalid SVG file)" << endl;
-        } else {
-          cerr << "Succeeded" << endl;
-          n++;
-        }
+      if (filesufx == "svg" || filesufx == "dsvgb") {
+        filenames.push_back(filename);
       }
     }
 
     closedir (dir);
+    sort(filenames.begin(), filenames.end());
+
+    // load the first valid file, the others are loaded when their tab is
+    // first shown
+    size_t n = 0;
+    for (size_t i = 0; i < filenames.size(); ++i) {
+      if (n) {
+        drawsvg->newTab(pathname + filenames[i]);
+        n++;
+        continue;
+      }
+      cerr << "[DrawSVG] Loading " << filenames[i] << "... "; 
+      if (loadFile(drawsvg, (pathname + filenames[i]).c_str()) < 0) {
+        cerr << "Failed (Invalid SVG file)" << endl;
+      } else {
+        cerr << "Succeeded" << endl;
+        n++;
+      }
+    }
 
     if (n) {
-      msg("Successfully Loaded " << n << " files from " << path);
+      msg("Found " << n << " files in " << path);
       return 0;
     }
 
@@ -88,8 +111,109 @@ int loadPath( DrawSVG* drawsvg, const char* path) {
   return -1;
 }
 
+int compileFile( const char* in_path, const char* out_path ) {
+
+  SVG svg;
+  if( SVGParser::load( in_path, &svg ) < 0 ) {
+    msg("File does not exist: " << in_path);
+    return -1;
+  }
+
+  // bake mip chains so loading never has to regenerate them
+  Sampler2DImp sampler;
+  vector<SVGElement*> elements = svg.elements;
+  for( size_t i = 0; i < elements.size(); ++i ) {
+    if( elements[i]->type == IMAGE ) {
+      sampler.generate_mips(static_cast<Image*>(elements[i])->tex, 0);
+    } else if( elements[i]->type == GROUP ) {
+      Group* group = static_cast<Group*>(elements[i]);
+      elements.insert(elements.end(), group->elements.begin(), group->elements.end());
+    }
+  }
+
+  if( SVGBinaryParser::save( out_path, &svg ) < 0 ) {
+    msg("Could not write " << out_path);
+    return -1;
+  }
+
+  msg("Compiled " << in_path << " to " << out_path);
+  return 0;
+}
+
+int renderFile( int argc, char** argv ) {
+
+  // drawsvg --render <in> <out.png> <width> <height> [tile size] [sample rate]
+  const char* in_path = argv[2];
+  const char* out_path = argv[3];
+  int width = atoi(argv[4]), height = atoi(argv[5]);
+  int tile_size = argc > 6 ? atoi(argv[6]) : 256;
+  int sample_rate = argc > 7 ? atoi(argv[7]) : 1;
+  if( width <= 0 || height <= 0 || tile_size <= 0 ) {
+    msg("Invalid size or tile size");
+    return -1;
+  }
+
+  OffscreenRenderer renderer;
+  if( sample_rate <= 0 || renderer.set_sample_rate( sample_rate ) < 0 ) {
+    msg("Invalid sample rate " << sample_rate << " (1 to "
+        << SoftwareRendererImp::kMaxSampleRate << ")");
+    return -1;
+  }
+  if( renderer.load_file( in_path ) < 0 ) {
+    msg("File does not exist: " << in_path);
+    return -1;
+  }
+  renderer.set_size( width, height );
+
+  if( renderer.render_png( out_path, tile_size ) < 0 ) {
+    msg("Could not write " << out_path);
+    return -1;
+  }
+
+  msg("Rendered " << in_path << " to " << out_path
+      << " (" << width << "x" << height << ")");
+  return 0;
+}
+
+int compareFiles( int argc, char** argv ) {
+
+  // drawsvg --compare <a.png> <b.png> [tolerance]
+  PNG a, b;
+  if( PNGParser::load( argv[2], a ) < 0 || PNGParser::load( argv[3], b ) < 0 ) {
+    msg("Could not read " << argv[2] << " or " << argv[3]);
+    return -1;
+  }
+  if( a.width != b.width || a.height != b.height ) {
+    msg("Image sizes differ: " << a.width << "x" << a.height << " and "
+        << b.width << "x" << b.height);
+    return -1;
+  }
+
+  int tolerance = argc > 4 ? atoi(argv[4]) : 0;
+  ImageMetrics metrics = compare_images( &a.pixels[0], &b.pixels[0],
+                                         a.width, a.height, tolerance );
+  cout << argv[2] << " " << argv[3] << ": " << metrics.summary() << endl;
+  return metrics.error_count ? 1 : 0;
+}
+
 int main( int argc, char** argv ) {
 
+  // compile a svg into a precompiled scene and exit
+  if( argc == 4 && strcmp(argv[1], "--compile") == 0 ) {
+    return compileFile(argv[2], argv[3]) < 0 ? 1 : 0;
+  }
+
+  // render a svg of any size to a png, tile by tile, and exit
+  if( argc >= 6 && argc <= 8 && strcmp(argv[1], "--render") == 0 ) {
+    return renderFile(argc, argv) < 0 ? 1 : 0;
+  }
+
+  // compare two pngs, exit status 1 if they differ by more than tolerance
+  if( (argc == 4 || argc == 5) && strcmp(argv[1], "--compare") == 0 ) {
+    int status = compareFiles(argc, argv);
+    return status < 0 ? 2 : status;
+  }
+
   // create viewer
   Viewer viewer = Viewer();
 
@@ -99,11 +223,21 @@ int main( int argc, char** argv ) {
   // set drawsvg as renderer
   viewer.set_renderer(drawsvg);
 
+  // cap the memory of loaded svgs
+  if( argc == 4 && strcmp(argv[1], "--memory") == 0 && atoi(argv[2]) > 0 ) {
+    drawsvg->setMemoryBudget( size_t(atoi(argv[2])) << 20 );
+    argv += 2; argc -= 2;
+  }
+
   // load tests
   if( argc == 2 ) {
     if (loadPath(drawsvg, argv[1]) < 0) exit(0);
   } else {
-    msg("Usage: drawsvg <path to test file or directory>"); exit(0);
+    msg("Usage: drawsvg [--memory <MB>] <path to test file or directory>");
+    msg("       drawsvg --compile <in.svg> <out.dsvgb>");
+    msg("       drawsvg --render <in.svg> <out.png> <width> <height>"
+        " [tile size] [sample rate]");
+    msg("       drawsvg --compare <a.png> <b.png> [tolerance]"); exit(0);
   }
 
   // init viewer
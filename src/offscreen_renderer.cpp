@@ -0,0 +1,178 @@
+#include "offscreen_renderer.h"
+#include "svg_binary.h"
+#include "viewport.h"
+#include "png.h"
+
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+namespace CMU462 {
+
+OffscreenRenderer::OffscreenRenderer()
+    : document( nullptr ), width( 0 ), height( 0 ), fit( true ),
+      svg_2_screen( Matrix3x3::identity() ),
+      target( nullptr ), target_w( 0 ), target_h( 0 ) {
+  renderer.set_tex_sampler( &sampler );
+}
+
+OffscreenRenderer::~OffscreenRenderer() {
+  delete document;
+}
+
+int OffscreenRenderer::load( const char* data, size_t size ) {
+
+  SVG* svg = new SVG();
+  if( SVGParser::load( data, size, svg ) < 0 ) {
+    delete svg;
+    return -1;
+  }
+  adopt( svg );
+  return 0;
+}
+
+int OffscreenRenderer::load_file( const char* path ) {
+
+  SVG* svg = new SVG();
+  size_t n = strlen( path );
+  bool binary = n >= 6 && !strcmp( path + n - 6, ".dsvgb" );
+  int status = binary ? SVGBinaryParser::load( path, svg )
+                      : SVGParser::load( path, svg );
+  if( status < 0 ) {
+    delete svg;
+    return -1;
+  }
+  adopt( svg );
+  return 0;
+}
+
+void OffscreenRenderer::adopt( SVG* svg ) {
+
+  // the renderer caches per element, drop it all before the old elements go
+  renderer.forget_svg();
+  delete document;
+  document = svg;
+  generate_mips( document->elements );
+}
+
+void OffscreenRenderer::generate_mips( vector<SVGElement*>& elements ) {
+
+  for( SVGElement* element : elements ) {
+    if( element->type == IMAGE ) {
+      Texture& tex = static_cast<Image*>(element)->tex;
+      if( tex.mipmap.size() <= 1 ) sampler.generate_mips( tex, 0 );
+    } else if( element->type == GROUP ) {
+      generate_mips( static_cast<Group*>(element)->elements );
+    }
+  }
+}
+
+void OffscreenRenderer::set_size( size_t width, size_t height ) {
+  this->width = width;
+  this->height = height;
+}
+
+void OffscreenRenderer::set_transform( const Matrix3x3& svg_2_screen ) {
+  this->svg_2_screen = svg_2_screen;
+  fit = false;
+}
+
+void OffscreenRenderer::fit_canvas() {
+  fit = true;
+}
+
+int OffscreenRenderer::set_sample_rate( size_t sample_rate ) {
+  if( sample_rate < 1 || sample_rate > SoftwareRendererImp::kMaxSampleRate ) {
+    return -1;
+  }
+  renderer.set_sample_rate( sample_rate );
+  return 0;
+}
+
+void OffscreenRenderer::set_aa_method( AAMethod method ) {
+  renderer.set_aa_method( method );
+}
+
+void OffscreenRenderer::set_line_aa( bool enabled ) {
+  renderer.set_line_aa( enabled );
+}
+
+void OffscreenRenderer::set_canvas_outline( bool enabled ) {
+  renderer.set_canvas_outline( enabled );
+}
+
+void OffscreenRenderer::prepare( unsigned char* rgba ) {
+
+  if( rgba != target || width != target_w || height != target_h ) {
+    renderer.set_render_target( rgba, width, height );
+    target = rgba; target_w = width; target_h = height;
+  }
+  prepare_transform();
+}
+
+void OffscreenRenderer::prepare_transform() {
+
+  if( fit ) {
+    // same default view as the viewer
+    ViewportImp viewport;
+    float span = 1.2 * max( document->width, document->height ) / 2;
+    viewport.set_viewbox( document->width / 2, document->height / 2, span );
+    float scale = min( width, height );
+    Matrix3x3 norm_to_screen = Matrix3x3::identity();
+    norm_to_screen(0,0) = scale; norm_to_screen(0,2) = (width  - scale) / 2;
+    norm_to_screen(1,1) = scale; norm_to_screen(1,2) = (height - scale) / 2;
+    renderer.set_svg_2_screen( norm_to_screen * viewport.get_svg_2_norm() );
+  } else {
+    renderer.set_svg_2_screen( svg_2_screen );
+  }
+}
+
+int OffscreenRenderer::render( unsigned char* rgba ) {
+
+  if( !document || !rgba ) return -1;
+  prepare( rgba );
+  renderer.draw_svg( *document );
+  return 0;
+}
+
+void OffscreenRenderer::mark_dirty( SVGElement* element ) {
+  renderer.mark_dirty( element );
+}
+
+int OffscreenRenderer::render_dirty( unsigned char* rgba ) {
+
+  if( !document || !rgba ) return -1;
+  prepare( rgba );
+  renderer.redraw_dirty( *document );
+  return 0;
+}
+
+int OffscreenRenderer::render_png( const char* path, size_t tile_size ) {
+
+  if( !document || !tile_size || !width || !height ) return -1;
+
+  PNGWriter png;
+  if( png.open( path, width, height ) < 0 ) return -1;
+
+  // tiles are drawn as regions of the full frame, the render target (if
+  // any) is left alone
+  prepare_transform();
+  vector<unsigned char> tile( 4 * tile_size * tile_size );
+  vector<unsigned char> band( 4 * width * tile_size );
+  for( size_t y = 0; y < height; y += tile_size ) {
+    size_t h = min( tile_size, height - y );
+    for( size_t x = 0; x < width; x += tile_size ) {
+      size_t w = min( tile_size, width - x );
+      renderer.draw_region( *document, x, y, w, h, &tile[0] );
+      for( size_t row = 0; row < h; ++row ) {
+        memcpy( &band[4 * (row * width + x)], &tile[4 * row * w], 4 * w );
+      }
+    }
+    if( png.write_rows( &band[0], h ) < 0 ) break;
+  }
+
+  return png.close();
+}
+
+} // namespace CMU462
@@ -0,0 +1,109 @@
+#ifndef CMU462_OFFSCREEN_RENDERER_H
+#define CMU462_OFFSCREEN_RENDERER_H
+
+#include "svg.h"
+#include "texture.h"
+#include "software_renderer.h"
+
+namespace CMU462 {
+
+/**
+ * Offscreen SVG renderer.
+ * Renders with the software renderer into caller-owned RGBA buffers, with no
+ * window or OpenGL context involved. A document is loaded once and rendered
+ * any number of times, sample buffers, stroke meshes and mip chains are kept
+ * between renders.
+ */
+class OffscreenRenderer {
+ public:
+
+  OffscreenRenderer();
+  ~OffscreenRenderer();
+
+  /**
+   * Load a document, replacing the current one. The memory variant takes
+   * size bytes of svg xml, files may be .svg or precompiled .dsvgb scenes.
+   * Returns a negative value (and keeps the current document) on failure.
+   */
+  int load( const char* data, size_t size );
+  int load_file( const char* path );
+
+  /**
+   * The current document, nullptr before the first successful load. Edited
+   * elements must be passed to mark_dirty.
+   */
+  inline SVG* svg() { return document; }
+
+  /**
+   * Output size in pixels. Buffers passed to render hold 4 * width * height
+   * bytes, RGBA, top row first.
+   */
+  void set_size( size_t width, size_t height );
+
+  /**
+   * SVG to output pixel transformation. By default (and after fit_canvas)
+   * the whole canvas is shown centered with a margin, as the viewer does.
+   */
+  void set_transform( const Matrix3x3& svg_2_screen );
+  void fit_canvas();
+
+  /**
+   * Anti-aliasing settings, see SoftwareRendererImp. Sample rates outside
+   * 1..SoftwareRendererImp::kMaxSampleRate are rejected with a negative
+   * return value and leave the current rate unchanged.
+   */
+  int set_sample_rate( size_t sample_rate );
+  void set_aa_method( AAMethod method );
+  void set_line_aa( bool enabled );
+  void set_canvas_outline( bool enabled );
+
+  /**
+   * Render the document into rgba. Returns a negative value if there is
+   * no document to render.
+   */
+  int render( unsigned char* rgba );
+
+  /**
+   * Partial updates: mark edited elements, then render_dirty repaints only
+   * what changed in rgba, which must hold the previous render.
+   */
+  void mark_dirty( SVGElement* element );
+  int render_dirty( unsigned char* rgba );
+
+  /**
+   * Render straight into a png file, tile by tile. Each row of tiles is
+   * compressed and written as soon as it is done, so memory grows with the
+   * tile size (and the output width times tile_size for the pending row)
+   * rather than the output size, for images too large to render at once.
+   * Returns a negative value if there is no document or the file could not
+   * be written.
+   */
+  int render_png( const char* path, size_t tile_size = 256 );
+
+ private:
+
+  SVG* document;
+  Sampler2DImp sampler;
+  SoftwareRendererImp renderer;
+
+  size_t width, height;
+  bool fit;
+  Matrix3x3 svg_2_screen;
+
+  // render target the renderer currently points at
+  unsigned char* target;
+  size_t target_w, target_h;
+
+  // replace the document, baking mip chains its images are missing
+  void adopt( SVG* svg );
+  void generate_mips( std::vector<SVGElement*>& elements );
+
+  // point the renderer at rgba with the current size and transformation
+  void prepare( unsigned char* rgba );
+  void prepare_transform();
+
+}; // class OffscreenRenderer
+
+} // namespace CMU462
+
+#endif // CMU462_OFFSCREEN_RENDERER_H
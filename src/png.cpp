@@ -3,6 +3,9 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
 
 using namespace std;
 
@@ -555,7 +558,402 @@ int PNGParser::load(const char* filename, PNG& png) {
 }
 
 int PNGParser::save(const char *filename, const PNG& png) {
-  return 0;
+
+  PNGWriter writer;
+  if (writer.open(filename, png.width, png.height) < 0) return -1;
+  if (png.height > 0 &&
+      writer.write_rows(&png.pixels[0], png.height) < 0) {
+    writer.close();
+    return -1;
+  }
+  return writer.close();
+}
+
+// Encoder routines //
+
+namespace {
+
+const size_t kWindow = 1 << 15;
+const size_t kWindowMask = kWindow - 1;
+const size_t kHashSize = 1 << 15;
+const size_t kMinMatch = 3;
+const size_t kMaxMatch = 258;
+
+// hash chain steps per match search, more compress better but slower
+const int kMaxChain = 16;
+
+// IDAT chunks are written whenever this much compressed data is pending
+const size_t kChunkSize = 1 << 18;
+
+const int kLengthExtra[29] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4,
+  5, 5, 5, 5, 0
+};
+const int kLengthBase[29] = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+  67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+const int kDistanceExtra[30] = {
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10,
+  11, 11, 12, 12, 13, 13
+};
+const int kDistanceBase[30] = {
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513,
+  769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+
+inline int highest_bit(uint32_t v) {
+  int bit = 0;
+  while (v >>= 1) ++bit;
+  return bit;
+}
+
+// length code (0 - 28) of a match length (3 - 258)
+inline int length_code(size_t length) {
+  if (length == kMaxMatch) return 28;
+  uint32_t v = uint32_t(length - 3);
+  if (v < 8) return v;
+  int bit = highest_bit(v);
+  return 4 * (bit - 1) + ((v >> (bit - 2)) & 3);
+}
+
+// distance code (0 - 29) of a match distance (1 - 32768)
+inline int distance_code(size_t distance) {
+  uint32_t v = uint32_t(distance - 1);
+  if (v < 4) return v;
+  int bit = highest_bit(v);
+  return 2 * bit + ((v >> (bit - 1)) & 1);
+}
+
+// huffman codes are sent most significant bit first
+inline uint32_t reverse_bits(uint32_t code, int count) {
+  uint32_t r = 0;
+  for (int i = 0; i < count; ++i) {
+    r = (r << 1) | (code & 1);
+    code >>= 1;
+  }
+  return r;
+}
+
+struct FixedCodes {
+  uint32_t code[288];
+  int count[288];
+  uint32_t distance[30];
+  FixedCodes() {
+    for (int s = 0; s < 288; ++s) {
+      if (s < 144)      { code[s] = 0x30 + s;         count[s] = 8; }
+      else if (s < 256) { code[s] = 0x190 + s - 144;  count[s] = 9; }
+      else if (s < 280) { code[s] = s - 256;          count[s] = 7; }
+      else              { code[s] = 0xc0 + s - 280;   count[s] = 8; }
+      code[s] = reverse_bits(code[s], count[s]);
+    }
+    for (int d = 0; d < 30; ++d) distance[d] = reverse_bits(d, 5);
+  }
+};
+
+const FixedCodes& fixed_codes() {
+  static const FixedCodes codes;
+  return codes;
+}
+
+struct CRCTable {
+  uint32_t entry[256];
+  CRCTable() {
+    for (uint32_t n = 0; n < 256; ++n) {
+      uint32_t c = n;
+      for (int k = 0; k < 8; ++k) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+      entry[n] = c;
+    }
+  }
+};
+
+// the table is built on first use, static initialization is thread-safe
+uint32_t crc32(uint32_t crc, const unsigned char* data, size_t size) {
+  static const CRCTable table;
+  crc = ~crc;
+  for (size_t i = 0; i < size; ++i) {
+    crc = table.entry[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+inline void put_u32(unsigned char* out, uint32_t v) {
+  out[0] = v >> 24; out[1] = v >> 16; out[2] = v >> 8; out[3] = v;
+}
+
+inline uint32_t hash(const unsigned char* p) {
+  return ((uint32_t(p[0]) << 10) ^ (uint32_t(p[1]) << 5) ^ p[2]) &
+         (kHashSize - 1);
+}
+
+inline int paeth(int a, int b, int c) {
+  int p = a + b - c;
+  int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+  if (pa <= pb && pa <= pc) return a;
+  return pb <= pc ? b : c;
+}
+
+} // namespace
+
+PNGWriter::PNGWriter()
+    : file(nullptr), ok(false), width(0), height(0), rows_written(0),
+      window_end(0), pos(0), bits(0), bit_count(0),
+      adler_a(1), adler_b(0) {
+}
+
+PNGWriter::~PNGWriter() {
+  if (file) fclose(file);
+}
+
+int PNGWriter::open(const char* filename, int width, int height) {
+
+  if (file) fclose(file);
+  file = nullptr;
+  if (width <= 0 || height <= 0) return -1;
+  file = fopen(filename, "wb");
+  if (!file) return -1;
+
+  ok = true;
+  this->width = width;
+  this->height = height;
+  rows_written = 0;
+  prior.assign(4 * this->width, 0);
+  filtered.resize(4 * this->width + 1);
+  best.resize(4 * this->width + 1);
+  window.resize(2 * kWindow);
+  window_end = pos = 0;
+  head.assign(kHashSize, -1);
+  prev.assign(kWindow, -1);
+  bits = 0;
+  bit_count = 0;
+  idat.clear();
+  adler_a = 1;
+  adler_b = 0;
+
+  static const unsigned char signature[8] = {
+    137, 80, 78, 71, 13, 10, 26, 10
+  };
+  ok = fwrite(signature, 1, 8, file) == 8;
+
+  unsigned char ihdr[13];
+  put_u32(ihdr, width);
+  put_u32(ihdr + 4, height);
+  ihdr[8] = 8;  // bit depth
+  ihdr[9] = 6;  // RGBA
+  ihdr[10] = ihdr[11] = ihdr[12] = 0;
+  write_chunk("IHDR", ihdr, 13);
+
+  // zlib header (deflate, 32k window), then a single final fixed block
+  idat.push_back(0x78);
+  idat.push_back(0x01);
+  put_bits(1, 1);
+  put_bits(1, 2);
+
+  return ok ? 0 : -1;
+}
+
+int PNGWriter::write_rows(const unsigned char* rgba, size_t rows) {
+
+  if (!file || rows > height - rows_written) return -1;
+  size_t stride = 4 * width;
+  for (size_t y = 0; y < rows; ++y) {
+    filter_row(rgba + y * stride);
+    deflate(&best[0], best.size());
+    memcpy(&prior[0], rgba + y * stride, stride);
+  }
+  rows_written += rows;
+  if (idat.size() >= kChunkSize) write_idat();
+  return ok ? 0 : -1;
+}
+
+int PNGWriter::close() {
+
+  if (!file) return -1;
+
+  // compress what is left, end the block and append the checksum
+  encode(window_end);
+  put_symbol(256);
+  flush_bits();
+  unsigned char adler[4];
+  put_u32(adler, (adler_b << 16) | adler_a);
+  idat.insert(idat.end(), adler, adler + 4);
+  write_idat();
+  write_chunk("IEND", nullptr, 0);
+
+  bool complete = rows_written == height;
+  if (fclose(file) != 0) ok = false;
+  file = nullptr;
+  return ok && complete ? 0 : -1;
+}
+
+void PNGWriter::filter_row(const unsigned char* row) {
+
+  // try every filter type and keep the one with the smallest sum of
+  // absolute (signed) residuals
+  size_t stride = 4 * width;
+  const unsigned char* up = &prior[0];
+  unsigned long best_sum = ~0ul;
+  for (int type = 0; type < 5; ++type) {
+    filtered[0] = type;
+    unsigned char* out = &filtered[1];
+    unsigned long sum = 0;
+    for (size_t i = 0; i < stride; ++i) {
+      int a = i >= 4 ? row[i - 4] : 0;
+      int b = up[i];
+      int c = i >= 4 ? up[i - 4] : 0;
+      int predictor = 0;
+      switch (type) {
+        case 1: predictor = a; break;
+        case 2: predictor = b; break;
+        case 3: predictor = (a + b) >> 1; break;
+        case 4: predictor = paeth(a, b, c); break;
+      }
+      unsigned char v = row[i] - predictor;
+      out[i] = v;
+      sum += v < 128 ? v : 256 - v;
+    }
+    if (sum < best_sum) {
+      best_sum = sum;
+      best.swap(filtered);
+    }
+  }
+}
+
+void PNGWriter::deflate(const unsigned char* data, size_t size) {
+
+  // running adler-32 of the uncompressed stream
+  for (size_t i = 0; i < size; ) {
+    size_t n = min(size - i, size_t(5552));
+    for (size_t end = i + n; i < end; ++i) {
+      adler_a += data[i];
+      adler_b += adler_a;
+    }
+    adler_a %= 65521;
+    adler_b %= 65521;
+  }
+
+  // the last kMaxMatch bytes stay behind as they may extend a match
+  while (size > 0) {
+    if (window_end == window.size()) slide();
+    size_t n = min(size, window.size() - window_end);
+    memcpy(&window[window_end], data, n);
+    window_end += n;
+    data += n;
+    size -= n;
+    if (window_end > kMaxMatch) encode(window_end - kMaxMatch);
+  }
+}
+
+void PNGWriter::encode(size_t limit) {
+
+  const FixedCodes& codes = fixed_codes();
+  while (pos < limit) {
+
+    size_t available = window_end - pos;
+    size_t length = 0, distance = 0;
+    if (available >= kMinMatch) {
+      uint32_t h = hash(&window[pos]);
+      int32_t candidate = head[h];
+      prev[pos & kWindowMask] = candidate;
+      head[h] = int32_t(pos);
+
+      // longest match along the hash chain
+      size_t max_length = min(kMaxMatch, available);
+      const unsigned char* b = &window[pos];
+      for (int chain = kMaxChain; candidate >= 0 && chain > 0; --chain) {
+        if (pos - candidate >= kWindow) break;
+        const unsigned char* a = &window[candidate];
+        if (a[length] == b[length]) {
+          size_t n = 0;
+          while (n < max_length && a[n] == b[n]) ++n;
+          if (n > length) {
+            length = n;
+            distance = pos - candidate;
+            if (n == max_length) break;
+          }
+        }
+        int32_t next = prev[candidate & kWindowMask];
+        if (next >= candidate) break;
+        candidate = next;
+      }
+    }
+
+    if (length >= kMinMatch) {
+      int lc = length_code(length);
+      put_symbol(257 + lc);
+      put_bits(uint32_t(length - kLengthBase[lc]), kLengthExtra[lc]);
+      int dc = distance_code(distance);
+      put_bits(codes.distance[dc], 5);
+      put_bits(uint32_t(distance - kDistanceBase[dc]), kDistanceExtra[dc]);
+
+      // the bytes within the match start matches of their own
+      for (size_t i = 1; i < length; ++i) {
+        size_t p = pos + i;
+        if (window_end - p < kMinMatch) break;
+        uint32_t h = hash(&window[p]);
+        prev[p & kWindowMask] = head[h];
+        head[h] = int32_t(p);
+      }
+      pos += length;
+    } else {
+      put_symbol(window[pos]);
+      ++pos;
+    }
+  }
+}
+
+void PNGWriter::slide() {
+
+  // drop the older half of the window, chain entries into it go with it
+  memmove(&window[0], &window[kWindow], window_end - kWindow);
+  window_end -= kWindow;
+  pos -= kWindow;
+  for (int32_t& p : head) p = p >= int32_t(kWindow) ? p - int32_t(kWindow) : -1;
+  for (int32_t& p : prev) p = p >= int32_t(kWindow) ? p - int32_t(kWindow) : -1;
+}
+
+void PNGWriter::put_bits(uint32_t value, int count) {
+
+  bits |= uint64_t(value) << bit_count;
+  bit_count += count;
+  while (bit_count >= 8) {
+    idat.push_back(bits & 0xff);
+    bits >>= 8;
+    bit_count -= 8;
+  }
+}
+
+void PNGWriter::put_symbol(int symbol) {
+  const FixedCodes& codes = fixed_codes();
+  put_bits(codes.code[symbol], codes.count[symbol]);
+}
+
+void PNGWriter::flush_bits() {
+  if (bit_count > 0) put_bits(0, 8 - bit_count);
+}
+
+void PNGWriter::write_chunk(const char* type, const unsigned char* data,
+                            size_t size) {
+
+  unsigned char header[8];
+  put_u32(header, uint32_t(size));
+  memcpy(header + 4, type, 4);
+  uint32_t crc = crc32(0, header + 4, 4);
+  if (size) crc = crc32(crc, data, size);
+  unsigned char footer[4];
+  put_u32(footer, crc);
+
+  if (fwrite(header, 1, 8, file) != 8 ||
+      (size && fwrite(data, 1, size, file) != size) ||
+      fwrite(footer, 1, 4, file) != 4) {
+    ok = false;
+  }
+}
+
+void PNGWriter::write_idat() {
+  if (idat.empty()) return;
+  write_chunk("IDAT", &idat[0], idat.size());
+  idat.clear();
 }
 
 
@@ -3,6 +3,8 @@
 
 #include <map>
 #include <vector>
+#include <cstdio>
+#include <cstdint>
 
 #include "color.h"
 #include "vector2D.h"
@@ -23,6 +25,71 @@ class PNGParser {
   static int save( const char* filename, const PNG& png );
 }; // class PNGParser
 
+/**
+ * Streaming PNG encoder.
+ * Rows are filtered and deflated as they are written, and compressed data
+ * leaves in IDAT chunks as soon as a chunk fills up, so memory stays bounded
+ * by a couple of rows and the 32k deflate window whatever the image size.
+ * Images are 8-bit RGBA. Deflate uses a single fixed Huffman block, which
+ * costs some compression but needs no buffering of the symbols.
+ */
+class PNGWriter {
+ public:
+
+  PNGWriter();
+  ~PNGWriter();
+
+  /**
+   * Create filename and write the header. Returns a negative value if the
+   * file can not be created.
+   */
+  int open( const char* filename, int width, int height );
+
+  /**
+   * Append rows of 4 * width bytes each, top row first. Returns a negative
+   * value on write errors or past the last row.
+   */
+  int write_rows( const unsigned char* rgba, size_t rows );
+
+  /**
+   * Finish the image and close the file. Returns a negative value if any
+   * write failed or fewer than height rows were written.
+   */
+  int close();
+
+ private:
+
+  FILE* file;
+  bool ok;
+  size_t width, height, rows_written;
+
+  // previous row (unfiltered) and the filtered candidates of the current one
+  std::vector<unsigned char> prior;
+  std::vector<unsigned char> filtered, best;
+
+  // deflate: sliding window with hash chains
+  std::vector<unsigned char> window;
+  size_t window_end, pos;
+  std::vector<int32_t> head, prev;
+
+  // bit output, pending IDAT data and the zlib checksum
+  uint64_t bits;
+  int bit_count;
+  std::vector<unsigned char> idat;
+  uint32_t adler_a, adler_b;
+
+  void filter_row( const unsigned char* row );
+  void deflate( const unsigned char* data, size_t size );
+  void encode( size_t limit );
+  void slide();
+  void put_bits( uint32_t value, int count );
+  void put_symbol( int symbol );
+  void flush_bits();
+  void write_chunk( const char* type, const unsigned char* data, size_t size );
+  void write_idat();
+
+}; // class PNGWriter
+
 } // namespace CMU462
 
 #endif // CMU462_PNG_H
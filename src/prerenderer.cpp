@@ -0,0 +1,292 @@
+#include "prerenderer.h"
+#include "svg_binary.h"
+#include "tab_manager.h"
+#include "viewport.h"
+
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+namespace CMU462 {
+
+namespace {
+
+// the view of a tab shown for the first time, as DrawSVG fits it
+Matrix3x3 fit_view( const SVG& svg, const Matrix3x3& norm_to_screen ) {
+
+  ViewportRef viewport;
+  float span = 1.2 * max( svg.width, svg.height ) / 2;
+  viewport.set_viewbox( svg.width / 2, svg.height / 2, span );
+  return norm_to_screen * viewport.get_svg_2_norm();
+}
+
+// the mipmaps DrawSVG generates when a tab is shown
+void generate_mips( Sampler2D& sampler, SVG& svg ) {
+
+  for( size_t i = 0; i < svg.elements.size(); ++i ) {
+    if( svg.elements[i]->type == IMAGE ) {
+      Texture& tex = static_cast<Image*>(svg.elements[i])->tex;
+      if( tex.mipmap.size() <= 1 ) sampler.generate_mips( tex, 0 );
+    }
+  }
+}
+
+} // namespace
+
+bool Prerenderer::View::operator==( const View& view ) const {
+
+  if( width != view.width || height != view.height ||
+      sample_rate != view.sample_rate || aa_method != view.aa_method ||
+      line_aa != view.line_aa ) return false;
+  for( int i = 0; i < 3; ++i ) {
+    for( int j = 0; j < 3; ++j ) {
+      if( svg_2_screen(i, j) != view.svg_2_screen(i, j) ) return false;
+    }
+  }
+  return true;
+}
+
+Prerenderer::Prerenderer( size_t capacity )
+    : capacity( capacity ), clock( 0 ), busy( nullptr ),
+      reset_renderer( false ), stopping( false ) {
+  renderer.set_tex_sampler( &sampler );
+  worker = thread( &Prerenderer::work, this );
+}
+
+Prerenderer::~Prerenderer() {
+
+  {
+    lock_guard<mutex> guard( lock );
+    stopping = true;
+  }
+  wake.notify_all();
+  worker.join();
+
+  // svgs loaded in the background that were never handed over
+  vector<SVG*> owned;
+  for( size_t i = 0; i < frames.size(); ++i ) {
+    if( frames[i].owned ) owned.push_back( frames[i].svg );
+  }
+  sort( owned.begin(), owned.end() );
+  owned.erase( unique( owned.begin(), owned.end() ), owned.end() );
+  for( size_t i = 0; i < owned.size(); ++i ) delete owned[i];
+}
+
+void Prerenderer::request( const vector<Request>& requests ) {
+
+  {
+    lock_guard<mutex> guard( lock );
+    pending = requests;
+  }
+  wake.notify_all();
+}
+
+bool Prerenderer::fetch( const SVG* svg, const View& view,
+                         unsigned char* pixels ) {
+
+  lock_guard<mutex> guard( lock );
+  Frame* frame = find( svg, view );
+  if( !frame ) return false;
+  frame->last_use = ++clock;
+  memcpy( pixels, &frame->pixels[0], frame->pixels.size() );
+  return true;
+}
+
+void Prerenderer::store( SVG* svg, const View& view,
+                         const unsigned char* pixels ) {
+
+  lock_guard<mutex> guard( lock );
+  Frame* frame = find( svg, view );
+  if( frame ) {
+    frame->last_use = ++clock;
+    return;
+  }
+
+  Frame stored = { svg, false, 0, "", view,
+                   vector<unsigned char>( pixels, pixels + 4 * view.width * view.height ),
+                   ++clock };
+  insert( stored );
+}
+
+void Prerenderer::wait( const SVG* svg ) {
+
+  unique_lock<mutex> guard( lock );
+  done.wait( guard, [this, svg]() { return busy != svg; } );
+}
+
+SVG* Prerenderer::take_loaded( const string& path ) {
+
+  // wait for the worker to be done loading or drawing it
+  unique_lock<mutex> guard( lock );
+  Frame* frame = nullptr;
+  done.wait( guard, [this, &path, &frame]() {
+    frame = find_loaded( path );
+    return loading != path && ( !frame || busy != frame->svg );
+  });
+  if( !frame ) return nullptr;
+
+  SVG* svg = frame->svg;
+  for( size_t i = 0; i < frames.size(); ++i ) {
+    if( frames[i].svg == svg ) frames[i].owned = false;
+  }
+  return svg;
+}
+
+void Prerenderer::forget( const SVG* svg ) {
+
+  unique_lock<mutex> guard( lock );
+  done.wait( guard, [this, svg]() { return busy != svg; } );
+
+  bool owned = false;
+  for( size_t i = 0; i < frames.size(); ) {
+    if( frames[i].svg == svg ) {
+      owned |= frames[i].owned;
+      frames.erase( frames.begin() + i );
+    } else {
+      ++i;
+    }
+  }
+  if( owned ) delete svg;
+
+  for( size_t i = 0; i < pending.size(); ) {
+    if( pending[i].svg == svg ) pending.erase( pending.begin() + i );
+    else ++i;
+  }
+
+  // its stroke meshes may still be cached, keyed by its address
+  reset_renderer = true;
+}
+
+size_t Prerenderer::loaded_bytes() {
+
+  lock_guard<mutex> guard( lock );
+  vector<pair<const SVG*, size_t>> owned;
+  for( size_t i = 0; i < frames.size(); ++i ) {
+    if( frames[i].owned ) owned.push_back( make_pair( frames[i].svg, frames[i].bytes ) );
+  }
+  sort( owned.begin(), owned.end() );
+  owned.erase( unique( owned.begin(), owned.end() ), owned.end() );
+
+  size_t bytes = 0;
+  for( size_t i = 0; i < owned.size(); ++i ) bytes += owned[i].second;
+  return bytes;
+}
+
+void Prerenderer::work() {
+
+  unique_lock<mutex> guard( lock );
+  while( true ) {
+
+    wake.wait( guard, [this]() { return stopping || !pending.empty(); } );
+    if( stopping ) return;
+
+    Request job = pending.front();
+    pending.erase( pending.begin() );
+
+    // a file loaded before is drawn from memory, nothing to do if the frame
+    // is there already
+    SVG* svg = job.svg;
+    bool owned = false;
+    size_t bytes = 0;
+    if( !svg ) {
+      Frame* loaded = find_loaded( job.path );
+      if( loaded ) {
+        svg = loaded->svg;
+        bytes = loaded->bytes;
+      }
+      owned = true;
+    }
+    if( svg && !job.svg && job.fit ) {
+      job.view.svg_2_screen = fit_view( *svg, job.norm_to_screen );
+    }
+    if( svg && find( svg, job.view ) ) continue;
+
+    busy = svg;
+    if( !svg ) loading = job.path;
+    bool reset = reset_renderer;
+    reset_renderer = false;
+    guard.unlock();
+
+    if( !svg ) {
+      svg = new SVG();
+      if( SVGBinaryParser::load_file( job.path.c_str(), svg ) < 0 ) {
+        delete svg;
+        svg = nullptr;
+      } else {
+        generate_mips( sampler, *svg );
+        bytes = TabManager::measure( *svg );
+        if( job.fit ) {
+          job.view.svg_2_screen = fit_view( *svg, job.norm_to_screen );
+        }
+      }
+    }
+
+    vector<unsigned char> pixels;
+    if( svg ) {
+      const View& view = job.view;
+      pixels.resize( 4 * view.width * view.height );
+      if( reset ) renderer.forget_svg();
+      renderer.set_render_target( &pixels[0], view.width, view.height );
+      renderer.set_aa_method( view.aa_method );
+      renderer.set_sample_rate( view.sample_rate );
+      renderer.set_line_aa( view.line_aa );
+      renderer.set_svg_2_screen( view.svg_2_screen );
+      renderer.draw_svg( *svg );
+    }
+
+    guard.lock();
+    busy = nullptr;
+    loading.clear();
+    if( svg ) {
+      Frame frame = { svg, owned, bytes, job.path, job.view, move(pixels), ++clock };
+      insert( frame );
+    }
+    done.notify_all();
+  }
+}
+
+Prerenderer::Frame* Prerenderer::find( const SVG* svg, const View& view ) {
+
+  for( size_t i = 0; i < frames.size(); ++i ) {
+    if( frames[i].svg == svg && frames[i].view == view ) return &frames[i];
+  }
+  return nullptr;
+}
+
+Prerenderer::Frame* Prerenderer::find_loaded( const string& path ) {
+
+  for( size_t i = 0; i < frames.size(); ++i ) {
+    if( frames[i].owned && frames[i].path == path ) return &frames[i];
+  }
+  return nullptr;
+}
+
+void Prerenderer::insert( Frame& frame ) {
+
+  // evict the least recently used frame, an svg loaded in the background
+  // goes with its last frame unless the worker is drawing it (its new frame
+  // owns it then)
+  if( frames.size() >= capacity ) {
+    size_t oldest = 0;
+    for( size_t i = 1; i < frames.size(); ++i ) {
+      if( frames[i].last_use < frames[oldest].last_use ) oldest = i;
+    }
+    Frame evicted = move( frames[oldest] );
+    frames.erase( frames.begin() + oldest );
+    if( evicted.owned ) {
+      bool shared = false;
+      for( size_t i = 0; i < frames.size(); ++i ) {
+        shared |= frames[i].svg == evicted.svg;
+      }
+      if( !shared && evicted.svg != frame.svg && evicted.svg != busy ) {
+        delete evicted.svg;
+        reset_renderer = true;
+      }
+    }
+  }
+
+  frames.push_back( move(frame) );
+}
+
+} // namespace CMU462
@@ -0,0 +1,135 @@
+#ifndef CMU462_PRERENDERER_H
+#define CMU462_PRERENDERER_H
+
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+
+#include "svg.h"
+#include "texture.h"
+#include "software_renderer.h"
+
+namespace CMU462 {
+
+/**
+ * Background renderer for tabs about to be shown.
+ * A worker thread draws requested tabs with a software renderer of its own
+ * into a small cache of frames, loading the svgs of tabs that are not
+ * resident from their file first. Frames are keyed by the svg and the view
+ * they were drawn with, so a tab can be shown straight from the cache as
+ * long as nothing about its view changed.
+ */
+class Prerenderer {
+ public:
+
+  /**
+   * Everything a frame depends on besides the svg.
+   */
+  struct View {
+    size_t width, height;
+    Matrix3x3 svg_2_screen;
+    size_t sample_rate;
+    AAMethod aa_method;
+    bool line_aa;
+    bool operator==( const View& view ) const;
+  };
+
+  /**
+   * A tab to draw: a resident svg, or the file of one that is not. With fit
+   * set, a svg loaded from a file is fit to the window (norm_to_screen) like
+   * a tab shown for the first time instead of using view.svg_2_screen.
+   */
+  struct Request {
+    SVG* svg;
+    std::string path;
+    View view;
+    bool fit;
+    Matrix3x3 norm_to_screen;
+  };
+
+  Prerenderer( size_t capacity = 4 );
+  ~Prerenderer();
+
+  /**
+   * Replace the pending requests, the frame in progress is finished.
+   */
+  void request( const std::vector<Request>& requests );
+
+  /**
+   * Copy the frame of svg drawn with view into pixels (4 * width * height
+   * bytes). Returns false if there is no such frame.
+   */
+  bool fetch( const SVG* svg, const View& view, unsigned char* pixels );
+
+  /**
+   * Keep a frame drawn elsewhere, e.g. of the tab being left.
+   */
+  void store( SVG* svg, const View& view, const unsigned char* pixels );
+
+  /**
+   * Wait for the worker to be done drawing svg, call it before the svg is
+   * shown (and possibly changed) by the caller.
+   */
+  void wait( const SVG* svg );
+
+  /**
+   * Hand over the svg loaded from path in the background, the caller owns
+   * it from then on. Waits if it is being loaded or drawn. Returns nullptr
+   * if there is none.
+   */
+  SVG* take_loaded( const std::string& path );
+
+  /**
+   * Drop everything kept for svg, waiting for the worker to be done with
+   * it. Call it before changing or deleting an svg that was requested.
+   */
+  void forget( const SVG* svg );
+
+  /**
+   * Memory of the svgs loaded in the background and not handed over yet,
+   * as TabManager::measure counts it.
+   */
+  size_t loaded_bytes();
+
+ private:
+
+  struct Frame {
+    SVG* svg;
+    bool owned;        // loaded in the background, not handed over yet
+    size_t bytes;      // size of an owned svg
+    std::string path;
+    View view;
+    std::vector<unsigned char> pixels;
+    size_t last_use;
+  };
+
+  size_t capacity;
+  std::vector<Frame> frames;
+  size_t clock;
+
+  std::vector<Request> pending;
+  const SVG* busy;         // svg the worker is drawing (nullptr if none)
+  std::string loading;     // file the worker is loading (empty if none)
+  bool reset_renderer;     // a forgotten svg may be in the renderer caches
+  bool stopping;
+
+  std::mutex lock;
+  std::condition_variable wake, done;
+  std::thread worker;
+
+  // the worker's own renderer
+  Sampler2DImp sampler;
+  SoftwareRendererImp renderer;
+
+  void work();
+  Frame* find( const SVG* svg, const View& view );
+  Frame* find_loaded( const std::string& path );
+  void insert( Frame& frame );
+
+}; // class Prerenderer
+
+} // namespace CMU462
+
+#endif // CMU462_PRERENDERER_H
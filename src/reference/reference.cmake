@@ -28,7 +28,8 @@ if(DRAWSVG_BUILD_REFERENCE)
 
 else(DRAWSVG_BUILD_REFERENCE)
 
-  add_library( drawsvg_ref STATIC IMPORTED)
+  # global, the prerenderer test links it too
+  add_library( drawsvg_ref STATIC IMPORTED GLOBAL )
 
   # Import reference
   if (UNIX)
@@ -4,8 +4,11 @@
 #include <vector>
 #include <iostream>
 #include <algorithm>
+#include <bitset>
+#include <cstring>
 
 #include "triangulation.h"
+#include "stroker.h"
 
 #include <cassert>
 #define ASSERT_ENABLED
@@ -31,6 +34,27 @@ void SoftwareRendererImp::draw_svg(SVG &svg) {
   transforms.push(transformation);
 
   update_sample_buffer();
+  invalidate_samples();
+
+  // stroke meshes are only valid for the svg they were built from
+  if (stroke_mesh_svg != &svg) {
+    stroke_meshes.clear();
+    stroke_mesh_svg = &svg;
+  }
+
+  // bounds of a full frame are recorded when it is first patched, those
+  // from an earlier frame stay valid for the same svg and transformation
+  // once the elements marked dirty since are updated
+  if (!patching) {
+    if (!same_bounds(&svg, svg_2_screen)) {
+      element_bounds.clear();
+      bounds_svg = nullptr;
+    } else if (!dirty_elements.empty()) {
+      for (size_t i = 0; i < svg.elements.size(); ++i) {
+        collect_damage(svg.elements[i], svg_2_screen);
+      }
+    }
+  }
 
   // draw all elements
   for (size_t i = 0; i < svg.elements.size(); ++i) {
@@ -38,36 +62,375 @@ void SoftwareRendererImp::draw_svg(SVG &svg) {
   }
 
   // draw canvas outline
-  Vector2D a = transformRelatively(Vector2D(0, 0));
-  a.x--;
-  a.y--;
-  Vector2D b = transformRelatively(Vector2D(svg.width, 0));
-  b.x++;
-  b.y--;
-  Vector2D c = transformRelatively(Vector2D(0, svg.height));
-  c.x--;
-  c.y++;
-  Vector2D d = transform(Vector2D(svg.width, svg.height));
-  d.x++;
-  d.y++;
-
-  rasterize_line(a.x, a.y, b.x, b.y, Color::Black);
-  rasterize_line(a.x, a.y, c.x, c.y, Color::Black);
-  rasterize_line(d.x, d.y, b.x, b.y, Color::Black);
-  rasterize_line(d.x, d.y, c.x, c.y, Color::Black);
+  if (canvas_outline) {
+    Vector2D a = transformRelatively(Vector2D(0, 0));
+    a.x--;
+    a.y--;
+    Vector2D b = transformRelatively(Vector2D(svg.width, 0));
+    b.x++;
+    b.y--;
+    Vector2D c = transformRelatively(Vector2D(0, svg.height));
+    c.x--;
+    c.y++;
+    Vector2D d = transform(Vector2D(svg.width, svg.height));
+    d.x++;
+    d.y++;
+
+    rasterize_line(a.x, a.y, b.x, b.y, Color::Black);
+    rasterize_line(a.x, a.y, c.x, c.y, Color::Black);
+    rasterize_line(d.x, d.y, b.x, b.y, Color::Black);
+    rasterize_line(d.x, d.y, c.x, c.y, Color::Black);
+  }
 
   transforms.pop();
 
   // resolve and send to render target
   resolve();
 
+  if (!patching) {
+    frame_svg = &svg;
+    frame_target = render_target;
+    frame_w = target_w;
+    frame_h = target_h;
+    frame_rate = sample_rate;
+    frame_aa_method = aa_method;
+    frame_line_aa = line_aa;
+    frame_outline = canvas_outline;
+    frame_transform = svg_2_screen;
+    dirty_elements.clear();
+    damage = ScreenRect();
+  }
+
+}
+
+void SoftwareRendererImp::mark_dirty(SVGElement *element) {
+
+  // the old bounds are damaged, whatever happens to the element; before
+  // the frame has bounds its old extent is unknown, so all of it is
+  if (same_bounds(frame_svg, frame_transform)) {
+    auto it = element_bounds.find(element);
+    if (it != element_bounds.end()) damage.expand(it->second);
+  } else if (frame_svg) {
+    damage.expand(Vector2D(-INFINITY, -INFINITY));
+    damage.expand(Vector2D(INFINITY, INFINITY));
+  }
+  dirty_elements.insert(element);
+  forget_meshes(element);
+
+}
+
+void SoftwareRendererImp::redraw_dirty(SVG &svg) {
+
+  if (!same_frame(svg)) {
+    draw_svg(svg);
+    return;
+  }
+
+  // add the new bounds of the dirty elements, wherever they are now, or
+  // record the bounds of all elements on the first patch of the frame
+  if (same_bounds(&svg, svg_2_screen)) {
+    for (size_t i = 0; i < svg.elements.size(); ++i) {
+      collect_damage(svg.elements[i], svg_2_screen);
+    }
+  } else {
+    record_all_bounds(svg);
+  }
+  dirty_elements.clear();
+  ScreenRect region = damage;
+  damage = ScreenRect();
+  if (region.empty()) return;
+
+  // whole pixels within the target
+  double px0 = max(0.0, floor(region.x0));
+  double py0 = max(0.0, floor(region.y0));
+  double px1 = min(double(target_w), ceil(region.x1));
+  double py1 = min(double(target_h), ceil(region.y1));
+  if (px0 >= px1 || py0 >= py1) return;
+  size_t x0 = size_t(px0), y0 = size_t(py0);
+  size_t w = size_t(px1) - x0, h = size_t(py1) - y0;
+
+  patch_pixels.resize(4 * w * h);
+  draw_patch(svg, x0, y0, w, h, patch_pixels.data());
+
+  // copy it into the frame
+  for (size_t y = 0; y < h; ++y) {
+    memcpy(render_target + 4 * ((y0 + y) * target_w + x0),
+           &patch_pixels[4 * y * w], 4 * w);
+  }
+
+}
+
+void SoftwareRendererImp::draw_region(SVG &svg, size_t x, size_t y,
+                                      size_t w, size_t h,
+                                      unsigned char *pixels) {
+
+  if (!w || !h) return;
+
+  // bounds are recorded once per svg and transformation, so a frame drawn
+  // region by region only walks the geometry once
+  if (!same_bounds(&svg, svg_2_screen)) {
+    record_all_bounds(svg);
+
+    // the last frame can not be patched without its bounds
+    frame_svg = nullptr;
+  }
+
+  draw_patch(svg, x, y, w, h, pixels);
+
+}
+
+size_t SoftwareRendererImp::read_samples(size_t x, size_t y,
+                                         size_t w, size_t h,
+                                         unsigned char *rgba) const {
+
+  // patches lay the buffers out for themselves, only a full frame will do
+  const size_t n = sample_rate;
+  if (!frame_svg || aa_method == COVERAGE ||
+      sample_w != target_w * n || sample_h != target_h * n ||
+      x + w > target_w || y + h > target_h) return 0;
+
+  for (size_t sy = y * n; sy < (y + h) * n; ++sy) {
+    unsigned char *out = rgba + 4 * (sy - y * n) * w * n;
+    for (size_t sx = x * n; sx < (x + w) * n; ++sx, out += 4) {
+
+      // rows nothing was drawn on are white
+      Color c(1, 1, 1, 1);
+      if (aa_method == MSAA) {
+        if (cleared_rows[sy / n]) {
+          const MSAAPixel &p = msaa_buffer[sx / n + sy / n * target_w];
+          size_t i = sy % n * n + sx % n;
+          if (p.samples != kNoSamples) c = msaa_samples[p.samples + i];
+          else c = (p.mask >> i) & 1 ? p.top : p.base;
+        }
+      } else if (cleared_rows[sy]) {
+        c = sample_buffer[sx + sy * sample_w];
+      }
+
+      out[0] = static_cast<uint8_t>(c.r / c.a * 255);
+      out[1] = static_cast<uint8_t>(c.g / c.a * 255);
+      out[2] = static_cast<uint8_t>(c.b / c.a * 255);
+      out[3] = 255;
+    }
+  }
+  return n;
+
+}
+
+void SoftwareRendererImp::draw_patch(SVG &svg, size_t x0, size_t y0,
+                                     size_t w, size_t h,
+                                     unsigned char *pixels) {
+
+  // the buffers are laid out for the patch, the frame they hold has to be
+  // in the render target by then
+  update_render_target();
+
+  // draw the patch as a target of its own, shifted by whole pixels so that
+  // it samples exactly like the full frame
+  unsigned char *target = render_target;
+  size_t full_w = target_w, full_h = target_h;
+  Matrix3x3 screen = svg_2_screen;
+  Matrix3x3 shift = Matrix3x3::identity();
+  shift(0, 2) = -double(x0);
+  shift(1, 2) = -double(y0);
+
+  render_target = pixels;
+  target_w = w;
+  target_h = h;
+  svg_2_screen = shift * screen;
+  patch.x0 = x0;
+  patch.y0 = y0;
+  patch.x1 = x0 + w;
+  patch.y1 = y0 + h;
+  patching = true;
+  draw_svg(svg);
+  patching = false;
+  render_target = target;
+  target_w = full_w;
+  target_h = full_h;
+  svg_2_screen = screen;
+
+}
+
+void SoftwareRendererImp::forget_svg() {
+
+  stroke_meshes.clear();
+  stroke_mesh_svg = nullptr;
+  element_bounds.clear();
+  dirty_elements.clear();
+  damage = ScreenRect();
+  bounds_svg = nullptr;
+  frame_svg = nullptr;
+
+}
+
+bool SoftwareRendererImp::same_bounds(const SVG *svg,
+                                      const Matrix3x3 &transform) const {
+
+  if (!svg || bounds_svg != svg) return false;
+  for (int i = 0; i < 3; ++i)
+    for (int j = 0; j < 3; ++j)
+      if (bounds_transform(i, j) != transform(i, j)) return false;
+  return true;
+
+}
+
+void SoftwareRendererImp::record_all_bounds(const SVG &svg) {
+
+  element_bounds.clear();
+  for (size_t i = 0; i < svg.elements.size(); ++i) {
+    record_bounds(svg.elements[i], svg_2_screen);
+  }
+  bounds_svg = &svg;
+  bounds_transform = svg_2_screen;
+
+}
+
+bool SoftwareRendererImp::same_frame(const SVG &svg) const {
+
+  if (frame_svg != &svg || frame_target != render_target ||
+      frame_w != target_w || frame_h != target_h ||
+      frame_rate != sample_rate || frame_aa_method != aa_method ||
+      frame_line_aa != line_aa || frame_outline != canvas_outline)
+    return false;
+  for (int i = 0; i < 3; ++i)
+    for (int j = 0; j < 3; ++j)
+      if (frame_transform(i, j) != svg_2_screen(i, j)) return false;
+  return true;
+
+}
+
+SoftwareRendererImp::ScreenRect SoftwareRendererImp::record_bounds(
+    SVGElement *element, const Matrix3x3 &parent) {
+
+  Matrix3x3 m = parent * element->transform;
+  ScreenRect bounds;
+
+  if (element->type == GROUP) {
+    Group &group = static_cast<Group &>(*element);
+    for (size_t i = 0; i < group.elements.size(); ++i) {
+      bounds.expand(record_bounds(group.elements[i], m));
+    }
+    element_bounds[element] = bounds;
+    return bounds;
+  }
+
+  // bounding box in svg coordinates
+  ScreenRect box;
+  switch (element->type) {
+    case POINT:
+      box.expand(static_cast<Point &>(*element).position);
+      break;
+    case LINE:
+      box.expand(static_cast<Line &>(*element).from);
+      box.expand(static_cast<Line &>(*element).to);
+      break;
+    case POLYLINE:
+      for (const Vector2D &p : static_cast<Polyline &>(*element).points)
+        box.expand(p);
+      break;
+    case RECT:
+      box.expand(static_cast<Rect &>(*element).position);
+      box.expand(static_cast<Rect &>(*element).position +
+                 static_cast<Rect &>(*element).dimension);
+      break;
+    case POLYGON:
+      for (const Vector2D &p : static_cast<Polygon &>(*element).points)
+        box.expand(p);
+      break;
+    case ELLIPSE:
+      box.expand(static_cast<Ellipse &>(*element).center -
+                 static_cast<Ellipse &>(*element).radius);
+      box.expand(static_cast<Ellipse &>(*element).center +
+                 static_cast<Ellipse &>(*element).radius);
+      break;
+    case IMAGE:
+      box.expand(static_cast<Image &>(*element).position);
+      box.expand(static_cast<Image &>(*element).position +
+                 static_cast<Image &>(*element).dimension);
+      break;
+    default:
+      break;
+  }
+
+  if (!box.empty()) {
+
+    // strokes reach out by half their width, miters and square caps further
+    const Style &style = element->style;
+    if (style.strokeColor.a != 0 && element->type != POINT &&
+        element->type != IMAGE) {
+      double reach = style.strokeWidth / 2 * max(double(style.miterLimit), M_SQRT2);
+      box.x0 -= reach;
+      box.y0 -= reach;
+      box.x1 += reach;
+      box.y1 += reach;
+    }
+
+    Vector2D corners[4] = {{box.x0, box.y0}, {box.x1, box.y0},
+                           {box.x1, box.y1}, {box.x0, box.y1}};
+    if (is_affine(m)) {
+      transform(m, corners, corners, 4);
+      for (const Vector2D &p : corners) bounds.expand(p);
+      // antialiased edges and lines spill over to neighbouring pixels
+      bounds.x0 -= 2;
+      bounds.y0 -= 2;
+      bounds.x1 += 2;
+      bounds.y1 += 2;
+    } else {
+      // corners may end up behind the projection, assume the worst
+      bounds.x0 = bounds.y0 = -INFINITY;
+      bounds.x1 = bounds.y1 = INFINITY;
+    }
+  }
+
+  element_bounds[element] = bounds;
+  return bounds;
+
+}
+
+SoftwareRendererImp::ScreenRect SoftwareRendererImp::collect_damage(
+    SVGElement *element, const Matrix3x3 &parent) {
+
+  if (dirty_elements.count(element)) {
+    ScreenRect bounds = record_bounds(element, parent);
+    damage.expand(bounds);
+    return bounds;
+  }
+
+  // groups grow by what their dirty descendants cover now, so that a patch
+  // does not skip them
+  ScreenRect grown;
+  if (element->type == GROUP) {
+    Group &group = static_cast<Group &>(*element);
+    Matrix3x3 m = parent * element->transform;
+    for (size_t i = 0; i < group.elements.size(); ++i) {
+      grown.expand(collect_damage(group.elements[i], m));
+    }
+    if (!grown.empty()) element_bounds[element].expand(grown);
+  }
+  return grown;
+
+}
+
+void SoftwareRendererImp::forget_meshes(SVGElement *element) {
+
+  stroke_meshes.erase(element);
+  if (element->type == GROUP) {
+    Group &group = static_cast<Group &>(*element);
+    for (size_t i = 0; i < group.elements.size(); ++i) {
+      forget_meshes(group.elements[i]);
+    }
+  }
+
 }
 
 void SoftwareRendererImp::set_sample_rate(size_t sample_rate) {
 
   // Task 4: 
   // You may want to modify this for supersampling support
-  this->sample_rate = sample_rate;
+  sample_rate = max<size_t>(1, min(sample_rate, size_t(kMaxSampleRate)));
+  update_render_target();
+  this->ssaa_rate = sample_rate;
+  this->sample_rate = aa_method == COVERAGE ? 1 : sample_rate;
   update_sample_buffer();
 
 }
@@ -77,6 +440,9 @@ void SoftwareRendererImp::set_render_target(unsigned char *render_target,
 
   // Task 4: 
   // You may want to modify this for supersampling support
+  // (a frame that only went to the upload target can still be resolved
+  // into a target of the same size)
+  if (width != target_w || height != target_h) target_stale = false;
   this->render_target = render_target;
   this->target_w = width;
   this->target_h = height;
@@ -84,15 +450,67 @@ void SoftwareRendererImp::set_render_target(unsigned char *render_target,
 
 }
 
+void SoftwareRendererImp::set_aa_method(AAMethod method) {
+
+  // coverage is computed analytically and needs no extra samples
+  update_render_target();
+  this->aa_method = method;
+  this->sample_rate = method == COVERAGE ? 1 : ssaa_rate;
+  update_sample_buffer();
+
+}
+
 void SoftwareRendererImp::update_sample_buffer() {
   if (!this->render_target) return;
-  this->sample_h = this->target_h * this->sample_rate;
-  this->sample_w = this->target_w * this->sample_rate;
-  this->sample_buffer.assign(this->sample_h * this->sample_w, Color(1, 1, 1, 1));
+  size_t w = this->target_w * this->sample_rate;
+  size_t h = this->target_h * this->sample_rate;
+  if (w == this->sample_w && h == this->sample_h &&
+      this->sample_rate == this->buffer_rate &&
+      this->aa_method == this->buffer_aa_method) return;
+
+  this->sample_w = w;
+  this->sample_h = h;
+  this->buffer_rate = this->sample_rate;
+  this->buffer_aa_method = this->aa_method;
+  if (aa_method == MSAA) {
+    ASSERT(sample_rate >= 1 && sample_rate <= kMaxSampleRate);
+    this->msaa_full_mask = ~0u >> (32 - sample_rate * sample_rate);
+    size_t n = this->target_h * this->target_w;
+    if (this->msaa_buffer.size() < n) this->msaa_buffer.resize(n);
+    vector<Color>().swap(this->sample_buffer);
+  } else {
+    size_t n = this->sample_h * this->sample_w;
+    if (this->sample_buffer.size() < n) this->sample_buffer.resize(n);
+    vector<MSAAPixel>().swap(this->msaa_buffer);
+    vector<Color>().swap(this->msaa_samples);
+  }
+  select_kernels();
+  invalidate_samples();
+}
+
+void SoftwareRendererImp::invalidate_samples() {
+  cleared_rows.assign(aa_method == MSAA ? target_h : sample_h, 0);
+  msaa_samples.clear();
+}
+
+void SoftwareRendererImp::clear_row(size_t row) {
+  if (aa_method == MSAA) {
+    MSAAPixel white = {Color(1, 1, 1, 1), Color(1, 1, 1, 1), 0, kNoSamples};
+    fill_n(&msaa_buffer[row * target_w], target_w, white);
+  } else {
+    fill_n(&sample_buffer[row * sample_w], sample_w, Color(1, 1, 1, 1));
+  }
+  cleared_rows[row] = 1;
 }
 
 void SoftwareRendererImp::draw_element(SVGElement *element) {
 
+  // a patch only needs the elements reaching into it
+  if (patching) {
+    auto it = element_bounds.find(element);
+    if (it != element_bounds.end() && !it->second.overlaps(patch)) return;
+  }
+
   // Task 5 (part 1):
   // Modify this to implement the transformation stack
   transforms.push(transforms.top() * element->transform);
@@ -131,56 +549,35 @@ void SoftwareRendererImp::draw_point(Point &point) {
 
 void SoftwareRendererImp::draw_line(Line &line) {
 
-  Vector2D p0 = transformRelatively(line.from);
-  Vector2D p1 = transformRelatively(line.to);
-  rasterize_line(p0.x, p0.y, p1.x, p1.y, line.style.strokeColor);
+  if (line.style.strokeColor.a != 0) draw_stroke(line);
 
 }
 
 void SoftwareRendererImp::draw_polyline(Polyline &polyline) {
 
-  Color c = polyline.style.strokeColor;
+  if (polyline.style.strokeColor.a != 0) draw_stroke(polyline);
 
-  if (c.a != 0) {
-    int nPoints = polyline.points.size();
-    for (int i = 0; i < nPoints - 1; i++) {
-      Vector2D p0 = transformRelatively(polyline.points[(i + 0) % nPoints]);
-      Vector2D p1 = transformRelatively(polyline.points[(i + 1) % nPoints]);
-      rasterize_line(p0.x, p0.y, p1.x, p1.y, c);
-    }
-  }
 }
 
 void SoftwareRendererImp::draw_rect(Rect &rect) {
 
   Color c;
 
-  // draw as two triangles
+  // draw as a quad
   float x = rect.position.x;
   float y = rect.position.y;
   float w = rect.dimension.x;
   float h = rect.dimension.y;
 
-  Vector2D p0 = transformRelatively(Vector2D(x, y));
-  Vector2D p1 = transformRelatively(Vector2D(x + w, y));
-  Vector2D p2 = transformRelatively(Vector2D(x, y + h));
-  Vector2D p3 = transformRelatively(Vector2D(x + w, y + h));
+  Vector2D points[4] = {{x, y}, {x + w, y}, {x + w, y + h}, {x, y + h}};
+  transformRelatively(points, points, 4);
 
   // draw fill
   c = rect.style.fillColor;
-  if (c.a != 0) {
-    rasterize_triangle(p0.x, p0.y, p1.x, p1.y, p2.x, p2.y, c);
-    rasterize_triangle(p2.x, p2.y, p1.x, p1.y, p3.x, p3.y, c);
-  }
+  if (c.a != 0) rasterize_convex(points, 4, c);
 
   // draw outline
-  c = rect.style.strokeColor;
-  if (c.a != 0) {
-    rasterize_line(p0.x, p0.y, p1.x, p1.y, c);
-    rasterize_line(p1.x, p1.y, p3.x, p3.y, c);
-    rasterize_line(p3.x, p3.y, p2.x, p2.y, c);
-    rasterize_line(p2.x, p2.y, p0.x, p0.y, c);
-  }
+  if (rect.style.strokeColor.a != 0) draw_stroke(rect);
 
 }
 
@@ -190,36 +587,85 @@ void SoftwareRendererImp::draw_polygon(Polygon &polygon) {
 
   // draw fill
   c = polygon.style.fillColor;
-  if (c.a != 0) {
+  if (c.a != 0 && aa_method == COVERAGE) {
+
+    // the outline is accumulated as a whole, no triangulation seams
+    screen_points.resize(polygon.points.size());
+    transformRelatively(polygon.points.data(), screen_points.data(),
+                        screen_points.size());
+    rasterize_polygon_coverage(screen_points.data(), screen_points.size(), c);
+
+  } else if (c.a != 0) {
 
     // triangulate
     vector<Vector2D> triangles;
     triangulate(polygon, triangles);
 
     // draw as triangles
+    transformRelatively(triangles.data(), triangles.data(), triangles.size());
     for (size_t i = 0; i < triangles.size(); i += 3) {
-      Vector2D p0 = transformRelatively(triangles[i + 0]);
-      Vector2D p1 = transformRelatively(triangles[i + 1]);
-      Vector2D p2 = transformRelatively(triangles[i + 2]);
-      rasterize_triangle(p0.x, p0.y, p1.x, p1.y, p2.x, p2.y, c);
+      rasterize_convex(&triangles[i], 3, c);
     }
   }
 
   // draw outline
-  c = polygon.style.strokeColor;
-  if (c.a != 0) {
-    int nPoints = polygon.points.size();
-    for (int i = 0; i < nPoints; i++) {
-      Vector2D p0 = transformRelatively(polygon.points[(i + 0) % nPoints]);
-      Vector2D p1 = transformRelatively(polygon.points[(i + 1) % nPoints]);
-      rasterize_line(p0.x, p0.y, p1.x, p1.y, c);
-    }
-  }
+  if (polygon.style.strokeColor.a != 0) draw_stroke(polygon);
+
 }
 
 void SoftwareRendererImp::draw_ellipse(Ellipse &ellipse) {
 
   // Extra credit 
+  const vector<Vector2D> &circle = unit_circle(ellipse_bucket(ellipse));
+  Vector2D center = ellipse.center, radius = ellipse.radius;
+
+  // draw fill
+  Color c = ellipse.style.fillColor;
+  if (c.a != 0) {
+    // map the unit circle to the screen in one go
+    Matrix3x3 m = Matrix3x3::identity();
+    m(0, 0) = radius.x;
+    m(1, 1) = radius.y;
+    m(0, 2) = center.x;
+    m(1, 2) = center.y;
+    screen_points.resize(circle.size());
+    transform(transforms.top() * m, circle.data(), screen_points.data(),
+              circle.size());
+    rasterize_convex(screen_points.data(), screen_points.size(), c);
+  }
+
+  // draw outline
+  if (ellipse.style.strokeColor.a != 0) draw_stroke(ellipse);
+
+}
+
+int SoftwareRendererImp::ellipse_bucket(const Ellipse &ellipse) {
+
+  // on-screen radius from the scale of the current transformation
+  const Matrix3x3 &m = transforms.top();
+  double radius = max(ellipse.radius.x * hypot(m(0, 0), m(1, 0)),
+                      ellipse.radius.y * hypot(m(0, 1), m(1, 1)));
+  if (!(radius > 1)) return 0;
+  return radius < ldexp(1.0, kMaxEllipseBucket) ? int(ceil(log2(radius)))
+                                                : kMaxEllipseBucket;
+
+}
+
+const vector<Vector2D> &SoftwareRendererImp::unit_circle(int bucket) {
+
+  auto it = unit_circles.find(bucket);
+  if (it != unit_circles.end()) return it->second;
+
+  // fewest segments keeping the chord within a quarter pixel of the arc
+  double radius = ldexp(1.0, bucket);
+  int n = max(8, int(ceil(M_PI / acos(1 - 0.25 / radius))));
+  vector<Vector2D> &circle = unit_circles[bucket];
+  circle.resize(n);
+  for (int i = 0; i < n; ++i) {
+    double t = 2 * M_PI * i / n;
+    circle[i] = Vector2D(cos(t), sin(t));
+  }
+  return circle;
 
 }
 
@@ -239,6 +685,115 @@ void SoftwareRendererImp::draw_group(Group &group) {
 
 }
 
+void SoftwareRendererImp::draw_stroke(SVGElement &element) {
+
+  Color c = element.style.strokeColor;
+
+  // with antialiased lines, strokes at most one sample wide are drawn as
+  // lines weighted by their width instead of as a mesh
+  if (line_aa) {
+    const Matrix3x3 &m = transforms.top();
+    double scale = sqrt(abs(m(0, 0) * m(1, 1) - m(0, 1) * m(1, 0)));
+    double width = element.style.strokeWidth * scale * sample_rate;
+    if (width <= 1) {
+      if (!(width > 0)) return;
+      c.a *= float(width);
+      vector<Vector2D> outline;
+      bool closed;
+      stroke_outline(element, outline, closed);
+      transformRelatively(outline.data(), outline.data(), outline.size());
+      for (size_t i = 1; i < outline.size() + closed; ++i) {
+        const Vector2D &p0 = outline[i - 1];
+        const Vector2D &p1 = outline[i % outline.size()];
+        rasterize_line(p0.x, p0.y, p1.x, p1.y, c);
+      }
+      return;
+    }
+  }
+
+  const vector<Vector2D> &mesh = stroke_mesh(element);
+
+  if (aa_method == COVERAGE) {
+    // accumulate the whole mesh at once so that shared triangle edges leave
+    // no seams, with one winding so that overlaps add up instead of cancel
+    vector<Vector2D> &points = screen_points;
+    points.resize(mesh.size());
+    transformRelatively(mesh.data(), points.data(), mesh.size());
+    for (size_t i = 0; i < mesh.size(); i += 3) {
+      if (cross(points[i + 1] - points[i], points[i + 2] - points[i]) < 0)
+        swap(points[i + 1], points[i + 2]);
+    }
+    rasterize_polygon_coverage(points.data(), points.size(), c, 3);
+    return;
+  }
+
+  screen_points.resize(mesh.size());
+  transformRelatively(mesh.data(), screen_points.data(), mesh.size());
+  rasterize_mesh(screen_points.data(), screen_points.size(), c);
+
+}
+
+const vector<Vector2D> &SoftwareRendererImp::stroke_mesh(SVGElement &element) {
+
+  int bucket = 0;
+  if (element.type == ELLIPSE) {
+    bucket = ellipse_bucket(static_cast<Ellipse &>(element));
+  }
+  auto it = stroke_meshes.find(&element);
+  if (it != stroke_meshes.end() && it->second.bucket == bucket) {
+    return it->second.triangles;
+  }
+
+  vector<Vector2D> outline;
+  bool closed;
+  stroke_outline(element, outline, closed);
+
+  // svg defaults, the style has no join or cap attributes
+  StrokeMesh &mesh = stroke_meshes[&element];
+  mesh.bucket = bucket;
+  mesh.triangles.clear();
+  stroke(outline, closed, element.style.strokeWidth, element.style.miterLimit,
+         MITER_JOIN, BUTT_CAP, mesh.triangles);
+  return mesh.triangles;
+}
+
+void SoftwareRendererImp::stroke_outline(SVGElement &element,
+                                         vector<Vector2D> &outline,
+                                         bool &closed) {
+
+  closed = true;
+  switch (element.type) {
+    case LINE: {
+      Line &line = static_cast<Line &>(element);
+      outline = {line.from, line.to};
+      closed = false;
+      break;
+    }
+    case POLYLINE:
+      outline = static_cast<Polyline &>(element).points;
+      closed = false;
+      break;
+    case RECT: {
+      Rect &rect = static_cast<Rect &>(element);
+      Vector2D p = rect.position, d = rect.dimension;
+      outline = {p, p + Vector2D(d.x, 0), p + d, p + Vector2D(0, d.y)};
+      break;
+    }
+    case POLYGON:
+      outline = static_cast<Polygon &>(element).points;
+      break;
+    case ELLIPSE: {
+      Ellipse &ellipse = static_cast<Ellipse &>(element);
+      for (const Vector2D &p : unit_circle(ellipse_bucket(ellipse))) {
+        outline.push_back(ellipse.center + Vector2D(p.x * ellipse.radius.x,
+                                                    p.y * ellipse.radius.y));
+      }
+      break;
+    }
+    default:break;
+  }
+}
+
 // Rasterization //
 
 // The input arguments in the rasterization functions 
@@ -246,8 +801,16 @@ void SoftwareRendererImp::draw_group(Group &group) {
 
 void SoftwareRendererImp::rasterize_point(float x, float y, Color color) {
 
-  x *= float(sample_rate);
-  y *= float(sample_rate);
+  (this->*point_kernel)(x, y, color);
+
+}
+
+template <int N>
+void SoftwareRendererImp::rasterize_sampled_point(float x, float y,
+                                                  const Color &color) {
+
+  x *= float(rate<N>());
+  y *= float(rate<N>());
   // fill in the nearest pixel
   int sx = (int) floor(x);
   int sy = (int) floor(y);
@@ -256,7 +819,7 @@ void SoftwareRendererImp::rasterize_point(float x, float y, Color color) {
   if (overflow(sx, sy)) return;
 
   // fill sample - NOT doing alpha blending!
-  put_sample(sx, sy, color);
+  put_sample<N>(sx, sy, color);
 
 }
 
@@ -264,20 +827,88 @@ void SoftwareRendererImp::rasterize_line(float x0, float y0,
                                          float x1, float y1,
                                          const Color &color) {
 
+  (this->*line_kernel)(x0, y0, x1, y1, color);
+
+}
+
+template <int N>
+void SoftwareRendererImp::rasterize_sampled_line(float x0, float y0,
+                                                 float x1, float y1,
+                                                 const Color &color) {
+
   // Task 2:
   // Implement line rasterization
-  x0 *= float(sample_rate);
-  y0 *= float(sample_rate);
-  x1 *= float(sample_rate);
-  y1 *= float(sample_rate);
+  x0 *= float(rate<N>());
+  y0 *= float(rate<N>());
+  x1 *= float(rate<N>());
+  y1 *= float(rate<N>());
 //  rasterize_line_DDA(x0, y0, x1, y1, color);
 //  rasterize_line_midpoint(x0, y0, x1, y1, color);
-  rasterize_line_bresenham(x0, y0, x1, y1, color);
+  if (line_aa) {
+    rasterize_line_wu<N>(x0, y0, x1, y1, color);
+  } else {
+    rasterize_line_bresenham<N>(x0, y0, x1, y1, color);
+  }
 
 }
 
+template <int N>
+void SoftwareRendererImp::rasterize_line_wu(
+    float x0, float y0, float x1, float y1, const Color &color) {
+
+  // Xiaolin Wu: along the major axis every step splits the line's intensity
+  // between the two samples straddling it, proportional to their distance.
+  // The usual formulation puts sample centers at integer coordinates.
+  // Clipping leaves a margin so that the cut ends, weighted like real end
+  // points, stay off screen.
+  if (!clip_line(x0, y0, x1, y1, -2, -2, sample_w + 2, sample_h + 2)) return;
+  x0 -= 0.5f;
+  y0 -= 0.5f;
+  x1 -= 0.5f;
+  y1 -= 0.5f;
+  bool steep = abs(y1 - y0) > abs(x1 - x0);
+  if (steep) {
+    swap(x0, y0);
+    swap(x1, y1);
+  }
+  sort_by_x(x0, y0, x1, y1);
+
+  auto plot = [&](int x, int y, float coverage) {
+    if (steep) swap(x, y);
+    if (overflow(x, y) || coverage <= 0) return;
+    Color c = color;
+    c.a *= coverage;
+    put_sample<N>(x, y, c);
+  };
+  auto fpart = [](float f) { return f - floor(f); };
+
+  float dx = x1 - x0, dy = y1 - y0;
+  float gradient = dx == 0 ? 1 : dy / dx;
+
+  // endpoints are weighted by how much of their sample the line spans
+  float x_start = round(x0), y_start = y0 + gradient * (x_start - x0);
+  float gap = 1 - fpart(x0 + 0.5f);
+  plot(int(x_start), i_floor(y_start), (1 - fpart(y_start)) * gap);
+  plot(int(x_start), i_floor(y_start) + 1, fpart(y_start) * gap);
+
+  float x_end = round(x1), y_end = y1 + gradient * (x_end - x1);
+  if (x_end == x_start) return;
+  gap = fpart(x1 + 0.5f);
+  plot(int(x_end), i_floor(y_end), (1 - fpart(y_end)) * gap);
+  plot(int(x_end), i_floor(y_end) + 1, fpart(y_end) * gap);
+
+  int major_size = int(steep ? sample_h : sample_w);
+  int x_from = max(int(x_start) + 1, 0), x_to = min(int(x_end) - 1, major_size - 1);
+  float y = y_start + gradient * float(x_from - x_start);
+  for (int x = x_from; x <= x_to; ++x, y += gradient) {
+    plot(x, i_floor(y), 1 - fpart(y));
+    plot(x, i_floor(y) + 1, fpart(y));
+  }
+}
+
 void SoftwareRendererImp::rasterize_line_DDA(
     float x0, float y0, float x1, float y1, const Color &color) {
+  if (!clip_line(x0, y0, x1, y1, 0, 0, sample_w, sample_h)) return;
   if (slope_le_1(x0, y0, x1, y1)) {
     sort_by_x(x0, y0, x1, y1);
     float y = y0, k = (y1 - y0) / (x1 - x0);
@@ -303,6 +934,7 @@ void SoftwareRendererImp::rasterize_line_DDA(
 
 void SoftwareRendererImp::rasterize_line_midpoint(
     float x0, float y0, float x1, float y1, const Color &color) {
+  if (!clip_line(x0, y0, x1, y1, 0, 0, sample_w, sample_h)) return;
   if (slope_le_1(x0, y0, x1, y1)) {
     sort_by_x(x0, y0, x1, y1);
     int a = i_floor(y0) - i_floor(y1), b = i_floor(x1) - i_floor(x0);
@@ -348,114 +980,581 @@ void SoftwareRendererImp::rasterize_line_midpoint(
   }
 }
 
+template <int N>
 void SoftwareRendererImp::rasterize_line_bresenham(
     float x0, float y0, float x1, float y1, const Color &color) {
+  // end points are snapped like polygon vertices, within the guard band
+  if (abs(x0) > kGuardBand || abs(y0) > kGuardBand ||
+      abs(x1) > kGuardBand || abs(y1) > kGuardBand) {
+    if (!clip_line(x0, y0, x1, y1, -kGuardBand, -kGuardBand,
+                   kGuardBand, kGuardBand)) return;
+  }
   if (slope_le_1(x0, y0, x1, y1)) {
     sort_by_x(x0, y0, x1, y1);
-    int dx = i_floor(x1) - i_floor(x0), dy = i_floor(y1) - i_floor(y0);
-    int e_dx2 = dy > 0 ? -dx : dx;
-    auto [sx, to] = truncated_x_range(x0, x1);
-    for (int sy = i_floor(y0), dy2 = 2 * dy, dx2 = 2 * dx; sx <= to; ++sx) {
-      if (valid_sy(sy)) put_sample(sx, sy, color);
-      e_dx2 += dy2;
-      if (dy < 0 && e_dx2 < 0) {
-        --sy;
-        e_dx2 += dx2;
-      } else if (dy > 0 && e_dx2 > 0) {
-        ++sy;
-        e_dx2 -= dx2;
+    int sx0 = snap_floor(x0), sy0 = snap_floor(y0);
+    int dx = snap_floor(x1) - sx0, dy = snap_floor(y1) - sy0;
+    int k, to;
+    if (!clip_bresenham(sx0, sy0, dx, dy, sample_w, sample_h, k, to)) return;
+    int step = dy < 0 ? -1 : 1;
+    long long dy2 = 2LL * abs(dy), dx2 = 2LL * dx;
+    long long m = bresenham_minor_steps(k, dx, abs(dy));
+    long long e = dy2 * k - dx - dx2 * m;
+    for (int sx = sx0 + k, sy = sy0 + step * int(m); k <= to; ++k, ++sx) {
+      put_sample<N>(sx, sy, color);
+      e += dy2;
+      if (e > 0) {
+        sy += step;
+        e -= dx2;
       }
     }
   } else {
     sort_by_y(x0, y0, x1, y1);
-    int dx = i_floor(x1) - i_floor(x0), dy = i_floor(y1) - i_floor(y0);
-    int e_dy2 = dx > 0 ? -dy : dy;
-    auto [sy, to] = truncated_y_range(y0, y1);
-    for (int sx = i_floor(x0), dy2 = 2 * dy, dx2 = 2 * dx; sy <= to; ++sy) {
-      if (valid_sx(sx)) put_sample(sx, sy, color);
-      e_dy2 += dx2;
-      if (dx < 0 && e_dy2 < 0) {
-        --sx;
-        e_dy2 += dy2;
-      } else if (dx > 0 && e_dy2 > 0) {
-        ++sx;
-        e_dy2 -= dy2;
+    int sx0 = snap_floor(x0), sy0 = snap_floor(y0);
+    int dx = snap_floor(x1) - sx0, dy = snap_floor(y1) - sy0;
+    int k, to;
+    if (!clip_bresenham(sy0, sx0, dy, dx, sample_h, sample_w, k, to)) return;
+    int step = dx < 0 ? -1 : 1;
+    long long dx2 = 2LL * abs(dx), dy2 = 2LL * dy;
+    long long m = bresenham_minor_steps(k, dy, abs(dx));
+    long long e = dx2 * k - dy - dy2 * m;
+    for (int sy = sy0 + k, sx = sx0 + step * int(m); k <= to; ++k, ++sy) {
+      put_sample<N>(sx, sy, color);
+      e += dx2;
+      if (e > 0) {
+        sx += step;
+        e -= dy2;
       }
     }
   }
 }
 
+long long SoftwareRendererImp::bresenham_minor_steps(long long k,
+                                                     long long d_major,
+                                                     long long d_minor) {
+  // the error term before step k is 2 * d_minor * k - d_major
+  // - 2 * d_major * m and stays within (-2 * d_major, 0], except that
+  // rounded end points may ask for more than one minor step per major step
+  long long n = 2 * d_minor * k - d_major;
+  return n <= 0 ? 0 : min(k, (n + 2 * d_major - 1) / (2 * d_major));
+}
+
+bool SoftwareRendererImp::clip_bresenham(int major0, int minor0,
+                                         int d_major, int d_minor,
+                                         int major_size, int minor_size,
+                                         int &k_from, int &k_to) {
+  // steps along the major axis within the buffer
+  long long from = max(0, -major0);
+  long long to = min((long long) d_major, (long long) major_size - 1 - major0);
+
+  // minor steps m keeping the minor axis within the buffer, translated to
+  // major steps by inverting the monotonic bresenham_minor_steps
+  long long m_lo, m_hi;
+  if (d_minor >= 0) {
+    m_lo = -minor0;
+    m_hi = (long long) minor_size - 1 - minor0;
+  } else {
+    m_lo = (long long) minor0 - (minor_size - 1);
+    m_hi = minor0;
+  }
+  long long dx = d_major, dy = abs(d_minor);
+  if (m_hi < 0) return false;
+  if (m_lo > 0) {
+    if (dy == 0) return false;
+    from = max(from, max(m_lo, (2 * dx * m_lo - dx) / (2 * dy) + 1));
+  }
+  if (dy != 0) to = min(to, max(m_hi, (2 * dx * m_hi + dx) / (2 * dy)));
+
+  if (from > to) return false;
+  k_from = int(from);
+  k_to = int(to);
+  return true;
+}
+
+bool SoftwareRendererImp::clip_line(float &x0, float &y0,
+                                    float &x1, float &y1,
+                                    float x_min, float y_min,
+                                    float x_max, float y_max) {
+  // Liang-Barsky: shrink the parameter range [t0, t1] of the segment by
+  // each boundary it crosses
+  float dx = x1 - x0, dy = y1 - y0;
+  float p[4] = {-dx, dx, -dy, dy};
+  float q[4] = {x0 - x_min, x_max - x0, y0 - y_min, y_max - y0};
+  float t0 = 0, t1 = 1;
+  for (int i = 0; i < 4; ++i) {
+    if (p[i] == 0) {
+      if (q[i] < 0) return false;
+      continue;
+    }
+    float t = q[i] / p[i];
+    if (p[i] < 0) {
+      if (t > t1) return false;
+      t0 = max(t0, t);
+    } else {
+      if (t < t0) return false;
+      t1 = min(t1, t);
+    }
+  }
+  x1 = x0 + t1 * dx;
+  y1 = y0 + t1 * dy;
+  x0 += t0 * dx;
+  y0 += t0 * dy;
+  return true;
+}
+
 void SoftwareRendererImp::rasterize_triangle(float x0, float y0,
                                              float x1, float y1,
                                              float x2, float y2,
                                              const Color &color) {
   // Task 3: 
   // Implement triangle rasterization
+  Vector2D points[3] = {{x0, y0}, {x1, y1}, {x2, y2}};
+  rasterize_convex(points, 3, color);
 
-  x0 *= float(sample_rate);
-  y0 *= float(sample_rate);
-  x1 *= float(sample_rate);
-  y1 *= float(sample_rate);
-  x2 *= float(sample_rate);
-  y2 *= float(sample_rate);
-  // make sure (x0,y0) is the top
-  if (y1 > y0 && y1 > y2) {
-    swap(x0, x1);
-    swap(y0, y1);
-  } else if (y2 > y0 && y2 > y1) {
-    swap(x0, x2);
-    swap(y0, y2);
+}
+
+void SoftwareRendererImp::rasterize_convex(const Vector2D *points, size_t n,
+                                           const Color &color) {
+
+  if (aa_method == COVERAGE) {
+    rasterize_polygon_coverage(points, n, color);
+  } else {
+    (this->*convex_kernel)(points, n, color);
   }
 
-  // make sure (x0,y0) is the only top
-  if (y0 == y1) {
-    rasterize_triangle(x2, y2, x0, x1, y0, color);
-    return;
-  } else if (y0 == y2) {
-    rasterize_triangle(x1, y1, x0, x2, y0, color);
-    return;
+}
+
+template <int N>
+bool SoftwareRendererImp::setup_convex(const Vector2D *points, size_t n,
+                                       int64_t &sy_from, int64_t &sy_to) {
+
+  // vertices far outside the buffer are clipped to a guard band first, so
+  // that the edge functions cannot overflow
+  const double scale = rate<N>();
+  const double band = kGuardBand / scale;
+  bool clip = false;
+  for (size_t i = 0; i < n; ++i) {
+    clip |= abs(points[i].x) > band || abs(points[i].y) > band;
+  }
+  if (clip) {
+    guard_points.assign(points, points + n);
+    clip_to_guard_band(guard_points, band);
+    points = guard_points.data();
+    n = guard_points.size();
   }
+  if (n < 3) return false;
+
+  // snap to 24.8 sample coordinates
+  fixed_points.resize(n);
+  int64_t min_y = INT64_MAX, max_y = INT64_MIN;
+  double area = 0;
+  for (size_t i = 0; i < n; ++i) {
+    fixed_points[i].x = snap(points[i].x, scale);
+    fixed_points[i].y = snap(points[i].y, scale);
+    min_y = min(min_y, fixed_points[i].y);
+    max_y = max(max_y, fixed_points[i].y);
+  }
+  for (size_t i = 0, j = n - 1; i < n; j = i++) {
+    area += double(fixed_points[j].x) * double(fixed_points[i].y) -
+            double(fixed_points[i].x) * double(fixed_points[j].y);
+  }
+  if (area == 0) return false;
+
+  // edge functions a * x + b * y + c, positive inside; an edge only owns
+  // the samples exactly on it if it is a top or left edge, the others are
+  // biased by one so that e >= 0 is the coverage test for all of them
+  fixed_edges.clear();
+  for (size_t i = 0, j = n - 1; i < n; j = i++) {
+    FixedPoint p = fixed_points[j], q = fixed_points[i];
+    if (area < 0) swap(p, q);
+    FixedEdge e;
+    e.a = p.y - q.y;
+    e.b = q.x - p.x;
+    if (e.a == 0 && e.b == 0) continue;
+    e.c = p.x * q.y - q.x * p.y;
+    if (!(e.a > 0 || (e.a == 0 && e.b > 0))) e.c -= 1;
+    fixed_edges.push_back(e);
+  }
+
+  sy_from = max<int64_t>(0, ceil_div(min_y - kSubpixelHalf, kSubpixelOne));
+  sy_to = min<int64_t>(sample_h - 1, floor_div(max_y - kSubpixelHalf, kSubpixelOne));
+  return sy_from <= sy_to;
+
+}
 
-  // make sure p0->p1->p2 is counter-clockwise
-  if ((x1 == x2 && (x1 < x0) == (y1 < y2)) || x1 > x2) {
-    swap(x1, x2);
-    swap(y1, y2);
+bool SoftwareRendererImp::convex_span(int64_t sy,
+                                      int64_t &sx_from, int64_t &sx_to) const {
+
+  // solve each edge function for the sample centers on this row
+  int64_t py = sy * kSubpixelOne + kSubpixelHalf;
+  for (const FixedEdge &e : fixed_edges) {
+    int64_t k = e.b * py + e.c;
+    if (e.a == 0) {
+      if (k < 0) return false;
+    } else if (e.a > 0) {
+      int64_t px = ceil_div(-k, e.a);
+      sx_from = max(sx_from, (px - kSubpixelHalf + kSubpixelOne - 1) >> kSubpixelBits);
+    } else {
+      int64_t px = floor_div(k, -e.a);
+      sx_to = min(sx_to, (px - kSubpixelHalf) >> kSubpixelBits);
+    }
   }
+  return sx_from <= sx_to;
 
-  // horizontally cut into two parts - upper and lower
-  if (y1 == y2) {
-    rasterize_triangle(x0, y0, x1, x2, y1, color);
-  } else if (y1 < y2) {
-    float x = (x1 - x0) / (y1 - y0) * (y2 - y0) + x0;
-    rasterize_triangle(x0, y0, x, x2, y2, color);
-    rasterize_triangle(x1, y1, x, x2, y2, color);
-  } else {
-    float x = (x2 - x0) / (y2 - y0) * (y1 - y0) + x0;
-    rasterize_triangle(x0, y0, x1, x, y1, color);
-    rasterize_triangle(x2, y2, x1, x, y1, color);
-  }
-}
-
-void SoftwareRendererImp::rasterize_triangle(
-    float xTip, float yTip,
-    float xBase0, float xBase1, float yBase,
-    const Color &color
-) {
-  if (xBase0 > xBase1)
-    swap(xBase0, xBase1);
-  float kl = (xBase0 - xTip) / (yBase - yTip);
-  float bl = xTip - kl * yTip;
-  float kr = (xBase1 - xTip) / (yBase - yTip);
-  float br = xTip - kr * yTip;
-  if (yBase > yTip) swap(yBase, yTip);
-  int y_from = max(0, i_floor(yBase + 0.5f));
-  int y_to = min(int(sample_h) - 1, i_floor(yTip - 0.5f));
-  int x_from, x_to;
-  for (int sy = y_from, sx; sy <= y_to; ++sy) {
-    x_from = max(0, i_floor(kl * (0.5f + float(sy)) + bl + 0.5f));
-    x_to = min(int(sample_w) - 1, i_floor(kr * (0.5f + float(sy)) + br - 0.5f));
-    for (sx = x_from; sx <= x_to; ++sx)
-      put_sample(sx, sy, color);
+}
+
+void SoftwareRendererImp::clip_to_guard_band(vector<Vector2D> &polygon,
+                                             double band) {
+
+  // Sutherland-Hodgman against each side of the guard band
+  vector<Vector2D> input;
+  for (int side = 0; side < 4; ++side) {
+    input.swap(polygon);
+    polygon.clear();
+    auto distance = [side, band](const Vector2D &p) {
+      double v = side < 2 ? p.x : p.y;
+      return side % 2 ? band - v : v + band;
+    };
+    for (size_t i = 0, j = input.size() - 1; i < input.size(); j = i++) {
+      double dj = distance(input[j]), di = distance(input[i]);
+      if ((dj >= 0) != (di >= 0))
+        polygon.push_back(input[j] + (input[i] - input[j]) * (dj / (dj - di)));
+      if (di >= 0) polygon.push_back(input[i]);
+    }
+  }
+
+}
+
+template <int N>
+void SoftwareRendererImp::rasterize_convex_ssaa(const Vector2D *points,
+                                                size_t n, const Color &color) {
+
+  int64_t sy_from, sy_to;
+  if (!setup_convex<N>(points, n, sy_from, sy_to)) return;
+
+  Color pm_color = color.premultiplied();
+  for (int64_t sy = sy_from; sy <= sy_to; ++sy) {
+    int64_t sx_from = 0, sx_to = int64_t(sample_w) - 1;
+    if (!convex_span(sy, sx_from, sx_to)) continue;
+    touch_row(sy);
+    Color *row = &sample_buffer[sy * sample_w];
+    for (int64_t sx = sx_from; sx <= sx_to; ++sx)
+      row[sx] = pm_color.over(row[sx]);
+  }
+
+}
+
+void SoftwareRendererImp::rasterize_mesh(const Vector2D *points, size_t n,
+                                         const Color &color) {
+
+  (this->*mesh_kernel)(points, n, color);
+
+}
+
+template <int N>
+void SoftwareRendererImp::merge_mesh_spans(const Vector2D *points, size_t n) {
+
+  // the spans of all triangles on each sample row, merged so that samples
+  // under overlapping triangles are blended once
+  mesh_spans.clear();
+  for (size_t i = 0; i + 3 <= n; i += 3) {
+    int64_t sy_from, sy_to;
+    if (!setup_convex<N>(&points[i], 3, sy_from, sy_to)) continue;
+    for (int64_t sy = sy_from; sy <= sy_to; ++sy) {
+      int64_t sx_from = 0, sx_to = int64_t(sample_w) - 1;
+      if (convex_span(sy, sx_from, sx_to))
+        mesh_spans.push_back({sy, sx_from, sx_to});
+    }
+  }
+  sort(mesh_spans.begin(), mesh_spans.end(),
+       [](const MeshSpan &a, const MeshSpan &b) {
+         return a.sy < b.sy || (a.sy == b.sy && a.from < b.from);
+       });
+
+  size_t merged = 0;
+  for (size_t i = 1; i < mesh_spans.size(); ++i) {
+    MeshSpan &last = mesh_spans[merged];
+    const MeshSpan &span = mesh_spans[i];
+    if (span.sy == last.sy && span.from <= last.to + 1) {
+      last.to = max(last.to, span.to);
+    } else {
+      mesh_spans[++merged] = span;
+    }
+  }
+  if (!mesh_spans.empty()) mesh_spans.resize(merged + 1);
+
+}
+
+template <int N>
+void SoftwareRendererImp::rasterize_mesh_ssaa(const Vector2D *points, size_t n,
+                                              const Color &color) {
+
+  merge_mesh_spans<N>(points, n);
+  Color pm_color = color.premultiplied();
+  for (const MeshSpan &span : mesh_spans) {
+    touch_row(span.sy);
+    Color *row = &sample_buffer[span.sy * sample_w];
+    for (int64_t sx = span.from; sx <= span.to; ++sx)
+      row[sx] = pm_color.over(row[sx]);
+  }
+
+}
+
+template <int N>
+void SoftwareRendererImp::rasterize_mesh_msaa(const Vector2D *points, size_t n,
+                                              const Color &color) {
+
+  merge_mesh_spans<N>(points, n);
+
+  // the spans of the sample rows of each pixel row, turned into pixel masks
+  const int n_samples = rate<N>();
+  Color pm_color = color.premultiplied();
+  mesh_masks.assign(target_w, 0);
+  for (size_t i = 0; i < mesh_spans.size();) {
+    int64_t y = mesh_spans[i].sy / n_samples;
+    int64_t x_from = INT64_MAX, x_to = INT64_MIN;
+    for (; i < mesh_spans.size() && mesh_spans[i].sy / n_samples == y; ++i) {
+      const MeshSpan &span = mesh_spans[i];
+      int j = int(span.sy - y * n_samples);
+      x_from = min(x_from, span.from / n_samples);
+      x_to = max(x_to, span.to / n_samples);
+      for (int64_t x = span.from / n_samples; x <= span.to / n_samples; ++x) {
+        int64_t first = x * n_samples;
+        int64_t a = max(span.from, first);
+        int64_t b = min(span.to, first + n_samples - 1);
+        mesh_masks[x] |= ((1u << (b - a + 1)) - 1) << (j * n_samples + (a - first));
+      }
+    }
+    for (int64_t x = x_from; x <= x_to; ++x) {
+      if (mesh_masks[x]) msaa_fill(int(x), int(y), mesh_masks[x], pm_color);
+      mesh_masks[x] = 0;
+    }
+  }
+
+}
+
+template <int N>
+void SoftwareRendererImp::rasterize_convex_msaa(const Vector2D *points,
+                                                size_t n, const Color &color) {
+
+  const int n_samples = rate<N>();
+  int64_t sy_from, sy_to;
+  if (!setup_convex<N>(points, n, sy_from, sy_to)) return;
+
+  // spans of the sample rows of each pixel row, turned into pixel masks
+  Color pm_color = color.premultiplied();
+  int64_t lo[32], hi[32];
+  for (int64_t y = sy_from / n_samples; y <= sy_to / n_samples; ++y) {
+
+    int64_t span_lo = INT64_MAX, span_hi = INT64_MIN;
+    int64_t inner_lo = INT64_MIN, inner_hi = INT64_MAX;
+    for (int j = 0; j < n_samples; ++j) {
+      lo[j] = 0;
+      hi[j] = int64_t(sample_w) - 1;
+      if (!convex_span(y * n_samples + j, lo[j], hi[j])) {
+        lo[j] = INT64_MAX;
+        hi[j] = INT64_MIN;
+      }
+      span_lo = min(span_lo, lo[j]);
+      span_hi = max(span_hi, hi[j]);
+      inner_lo = max(inner_lo, lo[j]);
+      inner_hi = min(inner_hi, hi[j]);
+    }
+    if (span_lo > span_hi) continue;
+
+    for (int64_t x = span_lo / n_samples; x <= span_hi / n_samples; ++x) {
+      int64_t first = x * n_samples, last = first + n_samples - 1;
+      uint32_t mask = 0;
+      if (inner_lo <= first && last <= inner_hi) {
+        mask = msaa_full_mask;
+      } else {
+        for (int j = 0; j < n_samples; ++j) {
+          int64_t a = max(lo[j], first), b = min(hi[j], last);
+          if (a <= b)
+            mask |= ((1u << (b - a + 1)) - 1) << (j * n_samples + (a - first));
+        }
+      }
+      if (mask) msaa_fill(int(x), int(y), mask, pm_color);
+    }
+  }
+
+}
+
+void SoftwareRendererImp::msaa_fill(int x, int y, uint32_t mask,
+                                    const Color &pm_color) {
+
+  touch_row(y);
+  MSAAPixel &p = msaa_buffer[x + y * target_w];
+
+  if (p.samples == kNoSamples) {
+    if (mask == msaa_full_mask) {
+      p.base = pm_color.over(p.base);
+      p.top = pm_color.over(p.top);
+    } else if (p.mask == 0) {
+      p.top = pm_color.over(p.base);
+      p.mask = mask;
+    } else if (mask == p.mask) {
+      p.top = pm_color.over(p.top);
+    } else if (mask == (~p.mask & msaa_full_mask)) {
+      p.base = pm_color.over(p.base);
+    } else {
+      // a third distinct mask, expand to one color per sample
+      p.samples = msaa_samples.size();
+      for (size_t i = 0; i < sample_rate * sample_rate; ++i)
+        msaa_samples.push_back((p.mask >> i) & 1 ? p.top : p.base);
+    }
+    if (p.mask == msaa_full_mask) {
+      p.base = p.top;
+      p.mask = 0;
+    }
+    if (p.samples == kNoSamples) return;
+  }
+
+  Color *samples = &msaa_samples[p.samples];
+  for (size_t i = 0; mask; ++i, mask >>= 1)
+    if (mask & 1) samples[i] = pm_color.over(samples[i]);
+}
+
+void SoftwareRendererImp::rasterize_polygon_coverage(
+    const Vector2D *points, size_t count, const Color &color,
+    size_t contour_size) {
+
+  size_t n = contour_size ? contour_size : count;
+  if (n < 3 || count < n) return;
+
+  // bounding box of the polygon, clipped to the buffer
+  float min_x = points[0].x, max_x = points[0].x;
+  float min_y = points[0].y, max_y = points[0].y;
+  for (size_t i = 1; i < count; ++i) {
+    min_x = min(min_x, float(points[i].x));
+    max_x = max(max_x, float(points[i].x));
+    min_y = min(min_y, float(points[i].y));
+    max_y = max(max_y, float(points[i].y));
+  }
+  int bx0 = max(0, i_floor(min_x)), bx1 = min(int(sample_w), i_ceil(max_x));
+  int by0 = max(0, i_floor(min_y)), by1 = min(int(sample_h), i_ceil(max_y));
+  if (bx0 >= bx1 || by0 >= by1) return;
+
+  // the accumulation buffer only grows and is left zeroed after each use
+  coverage_w = bx1 - bx0;
+  coverage_h = by1 - by0;
+  size_t stride = coverage_w + 2;
+  if (coverage_buffer.size() < stride * coverage_h)
+    coverage_buffer.resize(stride * coverage_h, 0.0f);
+
+  for (size_t first = 0; first + n <= count; first += n) {
+    for (size_t i = first, j = first + n - 1; i < first + n; j = i++) {
+      accumulate_clipped_edge(float(points[j].x) - bx0, float(points[j].y) - by0,
+                              float(points[i].x) - bx0, float(points[i].y) - by0);
+    }
+  }
+
+  // integrate the signed area along each row into pixel coverage
+  for (size_t y = 0; y < coverage_h; ++y) {
+    float *row = &coverage_buffer[y * stride];
+    float acc = 0;
+    for (size_t x = 0; x < stride; ++x) {
+      acc += row[x];
+      row[x] = 0;
+      float cov = min(abs(acc), 1.0f);
+      if (x < coverage_w && cov >= 1.0f / 512) {
+        Color c = color;
+        c.a *= cov;
+        put_sample(bx0 + x, by0 + y, c);
+      }
+    }
+  }
+}
+
+void SoftwareRendererImp::accumulate_clipped_edge(float x0, float y0,
+                                                  float x1, float y1) {
+
+  float w = float(coverage_w), h = float(coverage_h);
+  if (y0 == y1) return;
+
+  // parts above or below the box do not affect it
+  if ((y0 <= 0 && y1 <= 0) || (y0 >= h && y1 >= h)) return;
+  float dxdy = (x1 - x0) / (y1 - y0);
+  if (y0 < 0) { x0 -= y0 * dxdy; y0 = 0; }
+  if (y1 < 0) { x1 -= y1 * dxdy; y1 = 0; }
+  if (y0 > h) { x0 += (h - y0) * dxdy; y0 = h; }
+  if (y1 > h) { x1 += (h - y1) * dxdy; y1 = h; }
+
+  // split at the left and right box borders, parts outside are projected
+  // onto the border so that they still contribute their winding
+  float t[4] = {0, 1, 1, 1};
+  int n = 1;
+  for (float border : {0.0f, w}) {
+    if ((x0 < border) != (x1 < border) && x0 != x1) {
+      t[n++] = (border - x0) / (x1 - x0);
+    }
+  }
+  if (n == 3 && t[1] > t[2]) swap(t[1], t[2]);
+  t[n] = 1;
+
+  for (int i = 0; i < n; ++i) {
+    float xa = x0 + (x1 - x0) * t[i], ya = y0 + (y1 - y0) * t[i];
+    float xb = x0 + (x1 - x0) * t[i + 1], yb = y0 + (y1 - y0) * t[i + 1];
+    accumulate_edge(min(max(xa, 0.0f), w), ya, min(max(xb, 0.0f), w), yb);
+  }
+}
+
+void SoftwareRendererImp::accumulate_edge(float x0, float y0,
+                                          float x1, float y1) {
+
+  // signed area accumulation as used by font rasterizers: every row the edge
+  // crosses receives the area to the right of the edge, so a prefix sum over
+  // the row yields the (winding weighted) coverage of each pixel
+  if (y0 == y1) return;
+  float dir = 1;
+  if (y0 > y1) {
+    swap(x0, x1);
+    swap(y0, y1);
+    dir = -1;
+  }
+
+  // x is computed from y on every row and clamped to the buffer, an x
+  // carried from row to row drifts past the borders through rounding
+  size_t stride = coverage_w + 2;
+  float w = float(coverage_w);
+  float dxdy = (x1 - x0) / (y1 - y0);
+  float x = min(max(x0, 0.0f), w);
+  int y_to = min(int(coverage_h), i_ceil(y1));
+  for (int y = max(0, i_floor(y0)); y < y_to; ++y) {
+
+    float *row = &coverage_buffer[y * stride];
+    float y_next = min(float(y + 1), y1);
+    float dy = y_next - max(float(y), y0);
+    float x_next = y_next == y1 ? x1 : x0 + dxdy * (y_next - y0);
+    x_next = min(max(x_next, 0.0f), w);
+    float d = dy * dir;
+
+    float xa = min(x, x_next), xb = max(x, x_next);
+    float xa_floor = floor(xa), xb_ceil = ceil(xb);
+    int xa_i = int(xa_floor), xb_i = int(xb_ceil);
+    if (xb_i <= xa_i + 1) {
+      // the edge stays within one pixel column
+      float xm = 0.5f * (x + x_next) - xa_floor;
+      row[xa_i] += d - d * xm;
+      row[xa_i + 1] += d * xm;
+    } else {
+      float s = 1 / (xb - xa);
+      float xa_f = xa - xa_floor;
+      float a0 = 0.5f * s * (1 - xa_f) * (1 - xa_f);
+      float xb_f = xb - xb_ceil + 1;
+      float am = 0.5f * s * xb_f * xb_f;
+      row[xa_i] += d * a0;
+      if (xb_i == xa_i + 2) {
+        row[xa_i + 1] += d * (1 - a0 - am);
+      } else {
+        float a1 = s * (1.5f - xa_f);
+        row[xa_i + 1] += d * (a1 - a0);
+        for (int xi = xa_i + 2; xi < xb_i - 1; ++xi) row[xi] += d * s;
+        float a2 = a1 + float(xb_i - xa_i - 3) * s;
+        row[xb_i - 1] += d * (1 - a2 - am);
+      }
+      row[xb_i] += d * am;
+    }
+    x = x_next;
   }
 }
 
@@ -464,18 +1563,37 @@ void SoftwareRendererImp::rasterize_image(float x0, float y0,
                                           Texture &tex) {
   // Task 6: 
   // Implement image rasterization
+
+  // images cover whole pixels, in MSAA mode they are shaded once per pixel
+  bool per_pixel = aa_method == MSAA;
+  double scale = per_pixel ? 1 : double(sample_rate);
+  int64_t w = per_pixel ? target_w : sample_w;
+  int64_t h = per_pixel ? target_h : sample_h;
+
+  // sample centers within [x0, x1) x [y0, y1), snapped like polygons
+  int64_t fx0 = snap(x0, scale), fx1 = snap(x1, scale);
+  int64_t fy0 = snap(y0, scale), fy1 = snap(y1, scale);
+  if (fx1 <= fx0 || fy1 <= fy0) return;
+  int64_t sx_from = max<int64_t>(0, ceil_div(fx0 - kSubpixelHalf, kSubpixelOne));
+  int64_t sx_to = min(w, ceil_div(fx1 - kSubpixelHalf, kSubpixelOne)) - 1;
+  int64_t sy_from = max<int64_t>(0, ceil_div(fy0 - kSubpixelHalf, kSubpixelOne));
+  int64_t sy_to = min(h, ceil_div(fy1 - kSubpixelHalf, kSubpixelOne)) - 1;
+
   float u, v;
-  auto [sy_from, sy_to] = truncated_y_range(y0 + 0.49999f, y1 - 0.5f);
-  auto [sx_from, sx_to] = truncated_x_range(x0 + 0.49999f, x1 - 0.5f);
   const float u_scale = (x1 - x0) / float(tex.width);
   const float v_scale = (y1 - y0) / float(tex.height);
-  for (int sy = sy_from; sy <= sy_to; ++sy) {
-    v = (float(sy) + 0.5f - y0) / (y1 - y0);
-    for (int sx = sx_from; sx <= sx_to; ++sx) {
-      u = (float(sx) + 0.5f - x0) / (x1 - x0);
-//      put_sample(sx, sy, sampler->sample_nearest(tex, u, v));
-//      put_sample(sx, sy, sampler->sample_bilinear(tex, u, v));
-      put_sample(sx, sy, sampler->sample_trilinear(tex, u, v, u_scale, v_scale));
+  for (int64_t sy = sy_from; sy <= sy_to; ++sy) {
+    v = float(sy * kSubpixelOne + kSubpixelHalf - fy0) / float(fy1 - fy0);
+    for (int64_t sx = sx_from; sx <= sx_to; ++sx) {
+      u = float(sx * kSubpixelOne + kSubpixelHalf - fx0) / float(fx1 - fx0);
+//      Color c = sampler->sample_nearest(tex, u, v);
+//      Color c = sampler->sample_bilinear(tex, u, v);
+      Color c = sampler->sample_trilinear(tex, u, v, u_scale, v_scale);
+      if (per_pixel) {
+        msaa_fill(int(sx), int(sy), msaa_full_mask, c.premultiplied());
+      } else {
+        put_sample(int(sx), int(sy), c);
+      }
     }
   }
 
@@ -487,19 +1605,116 @@ void SoftwareRendererImp::resolve() {
   // Task 4:
   // Implement supersampling
   // You may also need to modify other functions marked with "Task 4".
-  Color c;
-  size_t sample_squared = sample_rate * sample_rate;
-  float sample_squared_inverse = 1.0f / float(sample_squared);
-  for (int sy = 0; sy < target_h; ++sy)
-    for (int sx = 0; sx < target_w; ++sx) {
-      c.r = c.g = c.b = c.a = 0;
-      for (int i = 0; i < sample_squared; ++i)
-        c += sample_buffer[
-            (sy * sample_rate + i / sample_rate) * sample_w
-                + (sx * sample_rate + i % sample_rate)
-        ] * sample_squared_inverse;
-      put_pixel(sx, sy, c);
+  (this->*resolve_kernel)();
+  if (!patching) target_stale = upload_target != nullptr;
+
+}
+
+void SoftwareRendererImp::update_render_target() {
+
+  // the samples of the frame are still there as long as the buffers were
+  // not laid out again, which the setters and patches take care of
+  if (!target_stale) return;
+  unsigned char *upload = upload_target;
+  upload_target = nullptr;
+  resolve();
+  upload_target = upload;
+
+}
+
+template <int N>
+void SoftwareRendererImp::resolve_ssaa() {
+
+  // box filter over the n x n samples of each pixel, a compile time n lets
+  // the compiler unroll the sample loops
+  const int n = rate<N>();
+  const float sample_squared_inverse = 1.0f / float(n * n);
+  for (int y = 0; y < target_h; ++y) {
+
+    // pixel rows nothing was drawn on stay white
+    unsigned char *out = resolved_row(y);
+    bool drawn = false;
+    for (int j = 0; j < n; ++j) drawn |= cleared_rows[y * n + j] != 0;
+    if (!drawn) {
+      memset(out, 255, 4 * target_w);
+      continue;
     }
+    for (int j = 0; j < n; ++j) touch_row(y * n + j);
+
+    const Color *row = &sample_buffer[size_t(y) * n * sample_w];
+    for (int x = 0; x < target_w; ++x, out += 4) {
+      Color c(0, 0, 0, 0);
+      for (int j = 0; j < n; ++j) {
+        const Color *samples = row + j * sample_w + x * n;
+        for (int i = 0; i < n; ++i)
+          c += samples[i] * sample_squared_inverse;
+      }
+      put_pixel(out, c);
+    }
+  }
+
+}
+
+template <int N>
+void SoftwareRendererImp::resolve_msaa() {
+
+  const int n = rate<N>();
+  const float sample_squared_inverse = 1.0f / float(n * n);
+  for (int y = 0; y < target_h; ++y) {
+
+    // pixel rows nothing was drawn on stay white
+    unsigned char *out = resolved_row(y);
+    if (!cleared_rows[y]) {
+      memset(out, 255, 4 * target_w);
+      continue;
+    }
+
+    const MSAAPixel *p = &msaa_buffer[size_t(y) * target_w];
+    for (int x = 0; x < target_w; ++x, ++p, out += 4) {
+      Color c;
+      if (p->samples == kNoSamples) {
+        float k = float(bitset<32>(p->mask).count()) * sample_squared_inverse;
+        c = p->top * k + p->base * (1 - k);
+      } else {
+        c = Color(0, 0, 0, 0);
+        const Color *samples = &msaa_samples[p->samples];
+        for (int i = 0; i < n * n; ++i)
+          c += samples[i] * sample_squared_inverse;
+      }
+      put_pixel(out, c);
+    }
+  }
+
+}
+
+template <int N>
+void SoftwareRendererImp::select_kernels() {
+  bool msaa = aa_method == MSAA;
+  resolve_kernel = msaa ? &SoftwareRendererImp::resolve_msaa<N>
+                        : &SoftwareRendererImp::resolve_ssaa<N>;
+  convex_kernel = msaa ? &SoftwareRendererImp::rasterize_convex_msaa<N>
+                       : &SoftwareRendererImp::rasterize_convex_ssaa<N>;
+  mesh_kernel = msaa ? &SoftwareRendererImp::rasterize_mesh_msaa<N>
+                     : &SoftwareRendererImp::rasterize_mesh_ssaa<N>;
+  line_kernel = &SoftwareRendererImp::rasterize_sampled_line<N>;
+  point_kernel = &SoftwareRendererImp::rasterize_sampled_point<N>;
+}
+
+void SoftwareRendererImp::select_kernels() {
+
+  // dispatch on the sample rate once per frame, set_sample_rate keeps it
+  // within 1..kMaxSampleRate so every rate has its own kernels
+  static_assert(kMaxSampleRate == 4, "specialize the kernels on every rate");
+  switch (sample_rate) {
+    case 1: select_kernels<1>(); break;
+    case 2: select_kernels<2>(); break;
+    case 3: select_kernels<3>(); break;
+    case 4: select_kernels<4>(); break;
+    default:
+      ASSERT(sample_rate >= 1 && sample_rate <= kMaxSampleRate);
+      select_kernels<0>();
+      break;
+  }
 
 }
 
@@ -2,9 +2,13 @@
 #define CMU462_SOFTWARE_RENDERER_H
 
 #include <stdio.h>
+#include <cstdint>
+#include <cstring>
 #include <vector>
 #include <stack>
 #include <functional>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "CMU462.h"
 #include "texture.h"
@@ -12,6 +16,12 @@
 
 namespace CMU462 { // CMU462
 
+typedef enum AAMethod {
+  SSAA,     // supersampling, sample_rate^2 samples per pixel
+  MSAA,     // one color and a coverage mask per pixel, samples on edges only
+  COVERAGE  // analytic pixel coverage, one sample per pixel
+} AAMethod;
+
 class SoftwareRenderer : public SVGRenderer {
  public:
 
@@ -69,28 +79,178 @@ class SoftwareRenderer : public SVGRenderer {
 class SoftwareRendererImp : public SoftwareRenderer {
  public:
 
-  SoftwareRendererImp() : SoftwareRenderer() {
+  SoftwareRendererImp() : SoftwareRenderer(), aa_method(SSAA), ssaa_rate(1) {
     update_sample_buffer();
   }
 
   // draw an svg input to render target
   void draw_svg(SVG &svg);
 
-  // set sample rate
+  // highest sample rate per axis, MSAA keeps a 32 bit mask per pixel
+  static const size_t kMaxSampleRate = 4;
+
+  // set sample rate, clamped to 1..kMaxSampleRate
   void set_sample_rate(size_t sample_rate);
 
   // set render target
   void set_render_target(unsigned char *target_buffer,
                          size_t width, size_t height);
 
+  // set anti-aliasing method
+  void set_aa_method(AAMethod method);
+
+  inline AAMethod get_aa_method() const {
+    return aa_method;
+  }
+
+  // draw lines and hairline strokes with Wu antialiasing
+  inline void set_line_aa(bool enabled) {
+    line_aa = enabled;
+  }
+
+  inline bool get_line_aa() const {
+    return line_aa;
+  }
+
+  // frame the svg canvas with a black outline (on by default)
+  inline void set_canvas_outline(bool enabled) {
+    canvas_outline = enabled;
+  }
+
+  // mark an element as changed: call it before removing an element and
+  // before or after changing one, redraw_dirty repaints its old and new
+  // screen bounds
+  void mark_dirty(SVGElement *element);
+
+  // repaint only the damaged regions of the last frame drawn by draw_svg,
+  // falls back to a full draw if the target, transformation or settings
+  // changed since then
+  void redraw_dirty(SVG &svg);
+
+  // draw the w x h pixel region at (x, y) of the frame the current
+  // transformation describes into pixels (4 * w * h bytes, RGBA), leaving
+  // the render target alone; frames too large for one target are drawn
+  // region by region, skipping the elements outside of each
+  void draw_region(SVG &svg, size_t x, size_t y, size_t w, size_t h,
+                   unsigned char *pixels);
+
+  // copy the samples behind the w x h pixel region at (x, y) of the last
+  // frame into rgba, n x n texels per pixel and top row first, where n is
+  // the returned sample rate; returns 0 (and copies nothing) if the buffers
+  // do not hold the whole frame or there are no samples (coverage AA)
+  size_t read_samples(size_t x, size_t y, size_t w, size_t h,
+                      unsigned char *rgba) const;
+
+  // drop everything cached for the svgs drawn so far, call it before
+  // deleting one
+  void forget_svg();
+
+  // resolve full frames into pixels (4 * width * height bytes, RGBA)
+  // instead of the render target, bottom row first, the order OpenGL takes
+  // them in, e.g. a mapped pixel unpack buffer; nullptr to resolve into the
+  // render target again. The render target only gets such a frame when
+  // update_render_target asks for it
+  inline void set_upload_target(unsigned char *pixels) {
+    upload_target = pixels;
+  }
+
+  // resolve the last full frame into the render target again if it only
+  // went to the upload target, call it before reading the render target
+  void update_render_target();
+
  private:
 
+  // anti-aliasing method and the sample rate requested for SSAA
+  AAMethod aa_method;
+  size_t ssaa_rate;
+  bool line_aa = false;
+  bool canvas_outline = true;
+
   // supersampling
   std::vector<Color> sample_buffer;
-  size_t sample_w;
-  size_t sample_h;
+  size_t sample_w = 0;
+  size_t sample_h = 0;
   void update_sample_buffer();
 
+  // buffers only grow and are only laid out again when the target size,
+  // sample rate or anti-aliasing method changes
+  size_t buffer_rate = 0;
+  AAMethod buffer_aa_method = SSAA;
+
+  // buffer rows (of samples, or of pixels for MSAA) are cleared to white on
+  // their first write of a frame, rows never written resolve to white
+  std::vector<uint8_t> cleared_rows;
+  void invalidate_samples();
+  void clear_row(size_t row);
+  inline void touch_row(size_t row) {
+    if (!cleared_rows[row]) clear_row(row);
+  }
+
+  // multisampling: samples in mask hold top, the others hold base, pixels
+  // hit by more than two distinct masks get per-sample colors from a pool
+  struct MSAAPixel {
+    Color base;
+    Color top;
+    uint32_t mask;
+    uint32_t samples;
+  };
+  static const uint32_t kNoSamples = ~0u;
+  std::vector<MSAAPixel> msaa_buffer;
+  std::vector<Color> msaa_samples;
+  uint32_t msaa_full_mask;
+  void msaa_fill(int x, int y, uint32_t mask, const Color &pm_color);
+
+  // fixed point (24.8) polygon setup shared by the SSAA and MSAA paths:
+  // vertices are scaled to samples (N per pixel) and snapped, sample
+  // centers sit at half a sample, edges are evaluated exactly in 64 bit
+  // integers
+  struct FixedPoint {
+    int64_t x, y;
+  };
+  struct FixedEdge {
+    int64_t a, b, c;
+  };
+  std::vector<FixedPoint> fixed_points;
+  std::vector<FixedEdge> fixed_edges;
+  std::vector<Vector2D> guard_points;
+  template <int N>
+  bool setup_convex(const Vector2D *points, size_t n,
+                    int64_t &sy_from, int64_t &sy_to);
+  bool convex_span(int64_t sy, int64_t &sx_from, int64_t &sx_to) const;
+  static void clip_to_guard_band(std::vector<Vector2D> &polygon, double band);
+
+  // merged sample spans of a stroke mesh, and pixel masks of one row
+  struct MeshSpan {
+    int64_t sy, from, to;
+  };
+  std::vector<MeshSpan> mesh_spans;
+  std::vector<uint32_t> mesh_masks;
+
+  // analytic coverage (signed area accumulation over a bounding box)
+  std::vector<float> coverage_buffer;
+  size_t coverage_w;
+  size_t coverage_h;
+
+  // stroke meshes in object space, built on first use for each element of
+  // the svg drawn last (ellipses are rebuilt when their bucket changes)
+  struct StrokeMesh {
+    int bucket;
+    std::vector<Vector2D> triangles;
+  };
+  const SVG *stroke_mesh_svg = nullptr;
+  std::unordered_map<const SVGElement *, StrokeMesh> stroke_meshes;
+  const std::vector<Vector2D> &stroke_mesh(SVGElement &element);
+  void stroke_outline(SVGElement &element,
+                      std::vector<Vector2D> &outline, bool &closed);
+
+  // unit circles tessellated for on-screen radii up to 2^bucket pixels,
+  // larger radii share the last bucket (about 4500 segments) so that deep
+  // zooms neither grow the tessellation nor cache one per zoom level
+  static const int kMaxEllipseBucket = 20;
+  std::unordered_map<int, std::vector<Vector2D>> unit_circles;
+  const std::vector<Vector2D> &unit_circle(int bucket);
+  int ellipse_bucket(const Ellipse &ellipse);
+
   // transformation
   std::stack<Matrix3x3> transforms;
 
@@ -98,6 +258,13 @@ class SoftwareRendererImp : public SoftwareRenderer {
     return transform(transforms.top(), p);
   }
 
+  inline void transformRelatively(const Vector2D *in, Vector2D *out, size_t n) {
+    transform(transforms.top(), in, out, n);
+  }
+
+  // screen space vertices of the element being drawn
+  std::vector<Vector2D> screen_points;
+
   // Primitive Drawing //
 
   // Draws an SVG element
@@ -127,16 +294,33 @@ class SoftwareRendererImp : public SoftwareRenderer {
   // Draw a group
   void draw_group(Group &group);
 
+  // Draw the stroke of a line, polyline, rect or polygon
+  void draw_stroke(SVGElement &element);
+
   // Rasterization //
 
   // rasterize a point
   void rasterize_point(float x, float y, Color color);
 
+  template <int N>
+  void rasterize_sampled_point(float x, float y, const Color &color);
+
   // rasterize a line
   void rasterize_line(float x0, float y0,
                       float x1, float y1,
                       const Color &color);
 
+  template <int N>
+  void rasterize_sampled_line(float x0, float y0,
+                              float x1, float y1,
+                              const Color &color);
+
+  // the line kernels below take sample coordinates
+  template <int N>
+  void rasterize_line_wu(float x0, float y0,
+                         float x1, float y1,
+                         const Color &color);
+
   void rasterize_line_DDA(float x0, float y0,
                           float x1, float y1,
                           const Color &color);
@@ -145,22 +329,68 @@ class SoftwareRendererImp : public SoftwareRenderer {
                                float x1, float y1,
                                const Color &color);
 
+  template <int N>
   void rasterize_line_bresenham(float x0, float y0,
                                 float x1, float y1,
                                 const Color &color);
 
+  // clip a segment to a rectangle (Liang-Barsky), false if nothing is left
+  static bool clip_line(float &x0, float &y0, float &x1, float &y1,
+                        float x_min, float y_min, float x_max, float y_max);
+
+  // clip the steps [k_from, k_to] of an integer Bresenham line to a buffer
+  static bool clip_bresenham(int major0, int minor0, int d_major, int d_minor,
+                             int major_size, int minor_size,
+                             int &k_from, int &k_to);
+
+  // minor axis steps a Bresenham line takes before major step k
+  static long long bresenham_minor_steps(long long k, long long d_major,
+                                         long long d_minor);
+
   // rasterize a triangle
   void rasterize_triangle(float x0, float y0,
                           float x1, float y1,
                           float x2, float y2,
                           const Color &color);
 
-  // rasterize a triangle with horizontal base
-  void rasterize_triangle(
-      float xTip, float yTip,
-      float xBase0, float xBase1, float yBase,
-      const Color &color
-  );
+  // rasterize a convex polygon in the current anti-aliasing mode
+  void rasterize_convex(const Vector2D *points, size_t n, const Color &color);
+
+  // rasterize a convex polygon into the supersample buffer
+  template <int N>
+  void rasterize_convex_ssaa(const Vector2D *points, size_t n,
+                             const Color &color);
+
+  // rasterize a convex polygon into the multisample buffer
+  template <int N>
+  void rasterize_convex_msaa(const Vector2D *points, size_t n,
+                             const Color &color);
+
+  // rasterize a triangle mesh into the supersample or multisample buffer,
+  // covering each sample once where triangles overlap
+  void rasterize_mesh(const Vector2D *points, size_t n, const Color &color);
+
+  template <int N>
+  void rasterize_mesh_ssaa(const Vector2D *points, size_t n,
+                           const Color &color);
+
+  template <int N>
+  void rasterize_mesh_msaa(const Vector2D *points, size_t n,
+                           const Color &color);
+
+  // merge the sample spans of all triangles of a mesh into mesh_spans
+  template <int N>
+  void merge_mesh_spans(const Vector2D *points, size_t n);
+
+  // rasterize a closed polygon with exact pixel coverage, or consecutive
+  // closed contours of contour_size points each (nonzero winding)
+  void rasterize_polygon_coverage(const Vector2D *points, size_t count,
+                                  const Color &color,
+                                  size_t contour_size = 0);
+
+  // accumulate the signed area of an edge (coverage box coordinates)
+  void accumulate_edge(float x0, float y0, float x1, float y1);
+  void accumulate_clipped_edge(float x0, float y0, float x1, float y1);
 
   // rasterize an image
   void rasterize_image(float x0, float y0,
@@ -170,11 +400,116 @@ class SoftwareRendererImp : public SoftwareRenderer {
   // resolve samples to render target
   void resolve();
 
+  // full frames are resolved into the upload target while there is one,
+  // the render target misses the frame then (target_stale) until it is
+  // resolved again from the samples kept
+  unsigned char *upload_target = nullptr;
+  bool target_stale = false;
+  inline unsigned char *resolved_row(size_t y) {
+    if (upload_target && !patching)
+      return upload_target + 4 * (target_h - 1 - y) * target_w;
+    return render_target + 4 * y * target_w;
+  }
+
+  // kernels specialized on each sample rate up to kMaxSampleRate, and a
+  // generic version (N = 0) that reads sample_rate at run time; selected
+  // whenever the sample buffer is updated
+  template <int N> inline int rate() const {
+    return N ? N : int(sample_rate);
+  }
+  template <int N> void resolve_ssaa();
+  template <int N> void resolve_msaa();
+  template <int N> void select_kernels();
+  void select_kernels();
+  void (SoftwareRendererImp::*resolve_kernel)() = nullptr;
+  void (SoftwareRendererImp::*convex_kernel)(
+      const Vector2D *points, size_t n, const Color &color) = nullptr;
+  void (SoftwareRendererImp::*mesh_kernel)(
+      const Vector2D *points, size_t n, const Color &color) = nullptr;
+  void (SoftwareRendererImp::*line_kernel)(
+      float x0, float y0, float x1, float y1, const Color &color) = nullptr;
+  void (SoftwareRendererImp::*point_kernel)(
+      float x, float y, const Color &color) = nullptr;
+
+  // partial redraw: screen bounds of every element of the last full frame
+  // (recorded when it is first patched), elements changed since then and
+  // the bounds they used to cover
+  struct ScreenRect {
+    double x0 = INFINITY, y0 = INFINITY;
+    double x1 = -INFINITY, y1 = -INFINITY;
+    inline bool empty() const {
+      return !(x0 <= x1 && y0 <= y1);
+    }
+    inline void expand(const Vector2D &p) {
+      x0 = std::min(x0, p.x); y0 = std::min(y0, p.y);
+      x1 = std::max(x1, p.x); y1 = std::max(y1, p.y);
+    }
+    inline void expand(const ScreenRect &r) {
+      x0 = std::min(x0, r.x0); y0 = std::min(y0, r.y0);
+      x1 = std::max(x1, r.x1); y1 = std::max(y1, r.y1);
+    }
+    inline bool overlaps(const ScreenRect &r) const {
+      return x0 < r.x1 && r.x0 < x1 && y0 < r.y1 && r.y0 < y1;
+    }
+  };
+  std::unordered_map<const SVGElement *, ScreenRect> element_bounds;
+  std::unordered_set<const SVGElement *> dirty_elements;
+  ScreenRect damage;
+  const SVG *bounds_svg = nullptr;
+  Matrix3x3 bounds_transform;
+  bool same_bounds(const SVG *svg, const Matrix3x3 &transform) const;
+  void record_all_bounds(const SVG &svg);
+  ScreenRect record_bounds(SVGElement *element, const Matrix3x3 &parent);
+  ScreenRect collect_damage(SVGElement *element, const Matrix3x3 &parent);
+  void forget_meshes(SVGElement *element);
+
+  // the last full frame, which redraw_dirty patches
+  const SVG *frame_svg = nullptr;
+  const unsigned char *frame_target = nullptr;
+  size_t frame_w = 0, frame_h = 0, frame_rate = 0;
+  AAMethod frame_aa_method = SSAA;
+  bool frame_line_aa = false;
+  bool frame_outline = true;
+  Matrix3x3 frame_transform;
+  bool same_frame(const SVG &svg) const;
+
+  // while patching, draw_svg renders the patch (in full frame pixels) as a
+  // target of its own and skips the elements outside of it
+  bool patching = false;
+  ScreenRect patch;
+  std::vector<unsigned char> patch_pixels;
+  void draw_patch(SVG &svg, size_t x0, size_t y0, size_t w, size_t h,
+                  unsigned char *pixels);
+
   // helpers
   static inline int i_floor(float f) {
     return int(std::floor(f));
   }
 
+  // fixed point with 8 subpixel bits, coordinates (in samples) are kept
+  // within a guard band so that edge function products fit 64 bits
+  static const int kSubpixelBits = 8;
+  static const int64_t kSubpixelOne = 1 << kSubpixelBits;
+  static const int64_t kSubpixelHalf = 128;
+  static constexpr double kGuardBand = 1 << 22;
+
+  static inline int64_t snap(double v, double scale) {
+    return std::llround(v * (scale * kSubpixelOne));
+  }
+
+  static inline int snap_floor(float f) {
+    return int(floor_div(snap(f, 1), kSubpixelOne));
+  }
+
+  static inline int64_t floor_div(int64_t a, int64_t b) {
+    int64_t q = a / b;
+    return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+  }
+
+  static inline int64_t ceil_div(int64_t a, int64_t b) {
+    return -floor_div(-a, b);
+  }
+
   static inline int i_ceil(float f) {
     return int(std::ceil(f));
   }
@@ -191,26 +526,23 @@ class SoftwareRendererImp : public SoftwareRenderer {
     return !(valid_sx(sx) && valid_sy(sy));
   }
 
-  // set pixel color
-  inline void put_pixel(int sx, int sy, uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
-    auto base = 4 * (sx + sy * target_w);
-    render_target[base] = r;
-    render_target[base + 1] = g;
-    render_target[base + 2] = b;
-    render_target[base + 3] = a;
-  }
-
-  inline void put_pixel(int sx, int sy, const Color &pm_color) {
-    put_pixel(
-        sx, sy,
-        static_cast<uint8_t>(pm_color.r / pm_color.a * 255),
-        static_cast<uint8_t>(pm_color.g / pm_color.a * 255),
-        static_cast<uint8_t>(pm_color.b / pm_color.a * 255),
-        static_cast<uint8_t>(255)
-    );
+  // set pixel color, pixel points into a row resolved_row returned
+  inline void put_pixel(unsigned char *pixel, const Color &pm_color) {
+    pixel[0] = static_cast<uint8_t>(pm_color.r / pm_color.a * 255);
+    pixel[1] = static_cast<uint8_t>(pm_color.g / pm_color.a * 255);
+    pixel[2] = static_cast<uint8_t>(pm_color.b / pm_color.a * 255);
+    pixel[3] = 255;
   }
 
+  template <int N = 0>
   inline void put_sample(int sx, int sy, const Color &color) {
+    if (aa_method == MSAA) {
+      const int n = rate<N>();
+      msaa_fill(sx / n, sy / n, 1u << (sy % n * n + sx % n),
+                color.premultiplied());
+      return;
+    }
+    touch_row(sy);
     auto &base = sample_buffer[sx + sy * sample_w];
     base = color.premultiplied().over(base);
   }
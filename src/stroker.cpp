@@ -0,0 +1,137 @@
+#include "stroker.h"
+
+#include <cmath>
+#include <vector>
+
+using namespace std;
+
+namespace CMU462 {
+
+namespace {
+
+// maximum angle covered by one triangle of a round join or cap
+const double ARC_STEP = M_PI / 16;
+
+inline Vector2D perp(const Vector2D& v) {
+  return Vector2D(-v.y, v.x);
+}
+
+inline Vector2D rotate(const Vector2D& v, double angle) {
+  double c = cos(angle), s = sin(angle);
+  return Vector2D(c * v.x - s * v.y, s * v.x + c * v.y);
+}
+
+inline void add_triangle(vector<Vector2D>& triangles,
+                         const Vector2D& a, const Vector2D& b,
+                         const Vector2D& c) {
+  triangles.push_back(a);
+  triangles.push_back(b);
+  triangles.push_back(c);
+}
+
+// fan around center, starting at offset from and rotating by sweep
+void add_arc(vector<Vector2D>& triangles, const Vector2D& center,
+             const Vector2D& from, double sweep) {
+  int steps = max(1, int(ceil(fabs(sweep) / ARC_STEP)));
+  Vector2D prev = from;
+  for (int i = 1; i <= steps; ++i) {
+    Vector2D cur = rotate(from, sweep * i / steps);
+    add_triangle(triangles, center, center + prev, center + cur);
+    prev = cur;
+  }
+}
+
+void add_join(vector<Vector2D>& triangles, const Vector2D& v,
+              const Vector2D& d_in, const Vector2D& d_out, double hw,
+              float miter_limit, LineJoin join) {
+
+  double turn = cross(d_in, d_out);
+  if (fabs(turn) < 1e-12 && dot(d_in, d_out) > 0) return;
+
+  // the gap between the segments opens on the side opposite to the turn
+  double side = turn > 0 ? -1 : 1;
+  Vector2D a = perp(d_in) * (side * hw);
+  Vector2D b = perp(d_out) * (side * hw);
+
+  if (join == ROUND_JOIN) {
+    add_arc(triangles, v, a, atan2(cross(a, b), dot(a, b)));
+    return;
+  }
+
+  if (join == MITER_JOIN) {
+    // miter length over stroke width is 1 / cos of half the normal angle
+    Vector2D bisector = a + b;
+    if (bisector.norm2() > 1e-12 * hw * hw) {
+      bisector = bisector.unit();
+      double cos_half = dot(bisector, a) / hw;
+      if (cos_half > 0 && 1 / cos_half <= miter_limit) {
+        Vector2D tip = v + bisector * (hw / cos_half);
+        add_triangle(triangles, v, v + a, tip);
+        add_triangle(triangles, v, tip, v + b);
+        return;
+      }
+    }
+  }
+
+  add_triangle(triangles, v, v + a, v + b);
+}
+
+void add_cap(vector<Vector2D>& triangles, const Vector2D& v,
+             const Vector2D& d, double hw, LineCap cap) {
+
+  // d points away from the line
+  Vector2D off = perp(d) * hw;
+  if (cap == SQUARE_CAP) {
+    Vector2D e = d * hw;
+    add_triangle(triangles, v + off, v - off, v - off + e);
+    add_triangle(triangles, v + off, v - off + e, v + off + e);
+  } else if (cap == ROUND_CAP) {
+    add_arc(triangles, v, off, -M_PI);
+  }
+}
+
+} // namespace
+
+void stroke(const vector<Vector2D>& points, bool closed,
+            float width, float miter_limit,
+            LineJoin join, LineCap cap,
+            vector<Vector2D>& triangles ) {
+
+  // repeated points have no direction
+  vector<Vector2D> p;
+  for (const Vector2D& q : points) {
+    if (p.empty() || (q - p.back()).norm2() > 0) p.push_back(q);
+  }
+  if (closed && p.size() > 1 && (p.front() - p.back()).norm2() == 0) {
+    p.pop_back();
+  }
+  if (p.size() < 2 || !(width > 0)) return;
+
+  double hw = width / 2;
+  size_t n = p.size();
+  size_t segments = closed ? n : n - 1;
+
+  // one quad per segment
+  for (size_t i = 0; i < segments; ++i) {
+    const Vector2D& a = p[i];
+    const Vector2D& b = p[(i + 1) % n];
+    Vector2D off = perp((b - a).unit()) * hw;
+    add_triangle(triangles, a + off, b + off, b - off);
+    add_triangle(triangles, a + off, b - off, a - off);
+  }
+
+  // joins fill the gaps on the outer side of each corner
+  for (size_t i = closed ? 0 : 1; i < (closed ? n : n - 1); ++i) {
+    const Vector2D& prev = p[(i + n - 1) % n];
+    const Vector2D& next = p[(i + 1) % n];
+    add_join(triangles, p[i], (p[i] - prev).unit(), (next - p[i]).unit(),
+             hw, miter_limit, join);
+  }
+
+  if (!closed) {
+    add_cap(triangles, p[0], (p[0] - p[1]).unit(), hw, cap);
+    add_cap(triangles, p[n - 1], (p[n - 1] - p[n - 2]).unit(), hw, cap);
+  }
+}
+
+} // namespace CMU462
@@ -0,0 +1,29 @@
+#ifndef CMU462_STROKER_H
+#define CMU462_STROKER_H
+
+#include "svg.h"
+
+namespace CMU462 {
+
+typedef enum LineJoin {
+  MITER_JOIN,
+  ROUND_JOIN,
+  BEVEL_JOIN
+} LineJoin;
+
+typedef enum LineCap {
+  BUTT_CAP,
+  ROUND_CAP,
+  SQUARE_CAP
+} LineCap;
+
+// expands the stroke of a polyline (closed or open) into a triangle list,
+// miter joins longer than miter_limit * width fall back to bevel joins
+void stroke(const std::vector<Vector2D>& points, bool closed,
+            float width, float miter_limit,
+            LineJoin join, LineCap cap,
+            std::vector<Vector2D>& triangles );
+
+} // namespace CMU462
+
+#endif // CMU462_STROKER_H
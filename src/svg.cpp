@@ -7,6 +7,8 @@
 #include <sstream>
 #include <iostream>
 #include <algorithm>
+#include <cstring>
+#include <future>
 
 using namespace std;
 
@@ -26,36 +28,170 @@ SVG::~SVG() {
 
 // Parser //
 
-int SVGParser::load( const char* filename, SVG* svg ) {
+namespace {
 
-  ifstream in( filename );
-  if( !in.is_open() ) {
-     return -1;
+/**
+ * Pulls tags out of an xml file without building a document.
+ * The file is read in fixed size chunks, the next chunk is fetched on a
+ * worker thread while the current one is being parsed. Comments, processing
+ * instructions, doctypes, CDATA sections and text are skipped.
+ */
+class XMLTagReader {
+ public:
+
+  enum TagKind { START, END, EMPTY };
+
+  XMLTagReader( istream& in ) : in( in ), pos( 0 ), len( 0 ) {
+    current.resize( kChunkSize );
+    pending.resize( kChunkSize );
+    prefetch();
   }
-  in.close();
 
-  XMLDocument doc;
-  doc.LoadFile( filename );
-  if( doc.Error() ) {
-     doc.PrintError();
-     exit( 1 );
+  ~XMLTagReader() {
+    if( next_chunk.valid() ) next_chunk.wait();
   }
 
-  XMLElement* root = doc.FirstChildElement( "svg" );
-  if( !root ) {
-     cerr << "Error: not an SVG file!" << endl;
-     exit( 1 );
+  // Read the next tag. START and EMPTY tags are returned as a self-closing
+  // element ("<rect .../>") ready to be parsed on its own, END tags only
+  // carry the element name.
+  bool next( string& tag, TagKind& kind ) {
+
+    char c;
+    while( true ) {
+
+      // skip text content
+      do { if( !get(c) ) return false; } while( c != '<' );
+      if( !get(c) ) return false;
+
+      if( c == '?' ) {
+        if( !skip_past("?>") ) return false;
+      } else if( c == '!' ) {
+        if( !skip_declaration() ) return false;
+      } else if( c == '/' ) {
+        tag.clear();
+        while( get(c) && c != '>' ) {
+          if( !isspace( (unsigned char) c ) ) tag.push_back(c);
+        }
+        kind = END;
+        return true;
+      } else {
+        tag.assign( 1, '<' );
+        tag.push_back( c );
+        char quote = 0;
+        while( true ) {
+          if( !get(c) ) return false;
+          if( quote ) {
+            if( c == quote ) quote = 0;
+          } else if( c == '"' || c == '\'' ) {
+            quote = c;
+          } else if( c == '>' ) {
+            break;
+          }
+          tag.push_back( c );
+        }
+        kind = tag.back() == '/' ? EMPTY : START;
+        if( kind == START ) tag.push_back( '/' );
+        tag.push_back( '>' );
+        return true;
+      }
+    }
   }
 
-  root->QueryFloatAttribute( "width",  &svg->width  );
-  root->QueryFloatAttribute( "height", &svg->height );
+ private:
 
-  parseSVG( root, svg );
+  static const size_t kChunkSize = 1 << 20;
 
-  return 0;
+  istream& in;
+  vector<char> current;
+  vector<char> pending;
+  future<size_t> next_chunk;
+  size_t pos, len;
+
+  void prefetch() {
+    next_chunk = async( launch::async, [this]() {
+      in.read( pending.data(), pending.size() );
+      return (size_t) in.gcount();
+    });
+  }
+
+  inline bool get( char& c ) {
+    if( pos == len ) {
+      if( !next_chunk.valid() ) return false;
+      len = next_chunk.get();
+      pos = 0;
+      if( !len ) return false;
+      swap( current, pending );
+      prefetch();
+    }
+    c = current[pos++];
+    return true;
+  }
+
+  // Read up to and including the terminator. On a mismatch the match falls
+  // back to the longest prefix of the terminator that ends the text read so
+  // far (KMP), so that "]]]>" or "--->" are not missed.
+  bool skip_past( const char* terminator ) {
+    size_t n = strlen( terminator ), matched = 0; char c;
+    size_t fallback[4] = { 0 };  // terminators are at most "-->" long
+    for( size_t i = 1, k = 0; i < n; ++i ) {
+      while( k && terminator[i] != terminator[k] ) k = fallback[k - 1];
+      if( terminator[i] == terminator[k] ) ++k;
+      fallback[i] = k;
+    }
+    while( matched < n ) {
+      if( !get(c) ) return false;
+      while( matched && c != terminator[matched] ) matched = fallback[matched - 1];
+      if( c == terminator[matched] ) ++matched;
+    }
+    return true;
+  }
+
+  // skip "<!-- -->", "<![CDATA[ ]]>" and "<!DOCTYPE [...]>"
+  bool skip_declaration() {
+    char c;
+    if( !get(c) ) return false;
+    if( c == '-' ) return get(c) && skip_past("-->");
+    if( c == '[' ) return skip_past("]]>");
+    int depth = 0;
+    while( c != '>' || depth > 0 ) {
+      if( c == '[' ) ++depth;
+      if( c == ']' ) --depth;
+      if( !get(c) ) return false;
+    }
+    return true;
+  }
+
+}; // class XMLTagReader
+
+// read-only stream buffer over a document in memory, nothing is copied
+class MemoryBuffer : public streambuf {
+ public:
+  MemoryBuffer( const char* data, size_t size ) {
+    char* begin = const_cast<char*>( data );
+    setg( begin, begin, begin + size );
+  }
+};
+
+} // namespace
+
+int SVGParser::load( const char* filename, SVG* svg ) {
+
+  ifstream in( filename, ios::binary );
+  if( !in.is_open() ) {
+     return -1;
+  }
+
+  return load( in, svg );
+}
+
+int SVGParser::load( const char* data, size_t size, SVG* svg ) {
+
+  MemoryBuffer buffer( data, size );
+  istream in( &buffer );
+  return load( in, svg );
 }
 
-void SVGParser::parseSVG( XMLElement* xml, SVG* svg ) {
+int SVGParser::load( istream& in, SVG* svg ) {
 
   /* NOTE (sky):
    * SVG uses a "painters model" when drawing elements. Elements 
@@ -65,76 +201,164 @@ void SVGParser::parseSVG( XMLElement* xml, SVG* svg ) {
    * order when drawing elements.
    */
 
-  XMLElement* elem = xml->FirstChildElement();
-  while( elem ) {
+  // Elements are converted as soon as their start tag has been read, and
+  // the single-element document holding the tag is discarded right after,
+  // so the full xml tree is never materialized.
+  XMLTagReader reader( in );
+  XMLDocument doc;
+  string tag; XMLTagReader::TagKind kind;
 
-    string elementType ( elem->Value() );
-    if( elementType == "line" ) {
+  // element lists of the svg and all open groups
+  vector<vector<SVGElement*>*> open;
 
-      Line* line = new Line();
-      parseElement(elem, line );
-      parseLine( elem, line );
-      svg->elements.push_back( line );
+  // depth of unsupported (or childless) elements being skipped
+  size_t skip = 0;
 
-    } else if( elementType == "polyline" ) {
+  while( reader.next( tag, kind ) ) {
 
-      Polyline* polyline = new Polyline();
-      parseElement(elem, polyline );
-      parsePolyline( elem, polyline );
-      svg->elements.push_back( polyline );
+    if( kind == XMLTagReader::END ) {
+      if( skip ) {
+        --skip;
+      } else if( open.size() > 1 ) {
+        open.pop_back();
+      } else {
+        break; // end of svg
+      }
+      continue;
+    }
 
-    } else if( elementType == "rect" ) {
+    if( skip ) {
+      if( kind == XMLTagReader::START ) ++skip;
+      continue;
+    }
 
-      float w = elem->FloatAttribute("width" );
-      float h = elem->FloatAttribute("height");
+    doc.Parse( tag.c_str(), tag.size() );
+    if( doc.Error() ) {
+       doc.PrintError();
+       return -1;
+    }
+    XMLElement* xml = doc.RootElement();
 
-      // treat zero-size rectangles as points
-      if (w == 0 && h == 0) {
-        Point* point = new Point();
-        parseElement(elem, point );
-        parsePoint( elem, point );
-        svg->elements.push_back( point );
-      } else {
-        Rect* rect = new Rect();
-        parseElement( elem, rect );
-        parseRect( elem, rect );
-        svg->elements.push_back( rect );
+    if( open.empty() ) {
+
+      if( strcmp( xml->Value(), "svg" ) ) {
+         cerr << "Error: not an SVG file!" << endl;
+         return -1;
+      }
+
+      xml->QueryFloatAttribute( "width",  &svg->width  );
+      xml->QueryFloatAttribute( "height", &svg->height );
+      open.push_back( &svg->elements );
+      if( kind == XMLTagReader::EMPTY ) break;
+      continue;
+    }
+
+    SVGElement* element = parseChild( xml );
+    if( element ) open.back()->push_back( element );
+    if( kind == XMLTagReader::EMPTY ) continue;
+
+    if( element && element->type == GROUP ) {
+      if( open.size() > kMaxGroupDepth ) {
+        cerr << "Error: groups nested deeper than " << kMaxGroupDepth << endl;
+        return -1;
       }
+      open.push_back( &static_cast<Group*>(element)->elements );
+    } else {
+      skip = 1;
+    }
+  }
 
-    } else if( elementType == "polygon" ) {
+  if( open.empty() ) {
+     cerr << "Error: not an SVG file!" << endl;
+     return -1;
+  }
 
-      Polygon* polygon = new Polygon();
-      parseElement( elem, polygon);
-      parsePolygon( elem, polygon );
-      svg->elements.push_back( polygon );
+  return 0;
+}
+
+SVGElement* SVGParser::parseChild( XMLElement* elem ) {
 
-    } else if( elementType == "ellipse" ) {
+  string elementType ( elem->Value() );
+  if( elementType == "line" ) {
 
-      Ellipse* ellipse = new Ellipse();
-      parseElement( elem, ellipse);
-      parseEllipse( elem, ellipse );
-      svg->elements.push_back( ellipse );
+    Line* line = new Line();
+    parseElement( elem, line );
+    parseLine( elem, line );
+    return line;
 
-    } else if ( elementType == "image" ) {
+  } else if( elementType == "polyline" ) {
 
-      Image* image = new Image();
-      parseElement( elem, image);
-      parseImage( elem, image);
-      svg->elements.push_back( image ); 
+    Polyline* polyline = new Polyline();
+    parseElement( elem, polyline );
+    parsePolyline( elem, polyline );
+    return polyline;
 
-    } else if( elementType == "g" ) {
+  } else if( elementType == "rect" ) {
 
-       Group* group = new Group();
-       parseElement( elem, group);
-       parseGroup( elem, group );
-       svg->elements.push_back( group );
+    float w = elem->FloatAttribute("width" );
+    float h = elem->FloatAttribute("height");
 
+    // treat zero-size rectangles as points
+    if (w == 0 && h == 0) {
+      Point* point = new Point();
+      parseElement( elem, point );
+      parsePoint( elem, point );
+      return point;
     } else {
-       // unknown element type --- include default handler here if desired
+      Rect* rect = new Rect();
+      parseElement( elem, rect );
+      parseRect( elem, rect );
+      return rect;
     }
 
-    elem = elem->NextSiblingElement();
+  } else if( elementType == "polygon" ) {
+
+    Polygon* polygon = new Polygon();
+    parseElement( elem, polygon );
+    parsePolygon( elem, polygon );
+    return polygon;
+
+  } else if( elementType == "ellipse" ) {
+
+    Ellipse* ellipse = new Ellipse();
+    parseElement( elem, ellipse );
+    parseEllipse( elem, ellipse );
+    return ellipse;
+
+  } else if( elementType == "circle" ) {
+
+    Ellipse* ellipse = new Ellipse();
+    parseElement( elem, ellipse );
+    parseCircle( elem, ellipse );
+    return ellipse;
+
+  } else if ( elementType == "image" ) {
+
+    Image* image = new Image();
+    parseElement( elem, image );
+    parseImage( elem, image );
+    return image;
+
+  } else if( elementType == "g" ) {
+
+    /* NOTE (sky):
+     * A group contains a list of elements, and optionally a transformation
+     * to apply to all the elements it contains. Elements in a group follow
+     * the same draw order as elements in a svg (top to bottom).  
+     * A group should be considered as one single element outside its scope.
+     * This means at draw time, all elements in a group should be drawn before 
+     * elements outside the group. All elements in the group inherits the group
+     * transformation, and keep in mind that transformation is accumulative.
+     * Groups can also be nested.  
+     */
+    Group* group = new Group();
+    parseElement( elem, group );
+    return group;
+
   }
+
+  // unknown element type --- include default handler here if desired
+  return nullptr;
 }
 
 void SVGParser::parseElement( XMLElement* xml, SVGElement* element ) {
@@ -158,6 +382,8 @@ void SVGParser::parseElement( XMLElement* xml, SVGElement* element ) {
   }
 
 
+  style->strokeWidth = 1;
+  style->miterLimit  = 4;
   xml->QueryFloatAttribute( "stroke-width",      &style->strokeWidth );
   xml->QueryFloatAttribute( "stroke-miterlimit", &style->miterLimit  );
 
@@ -301,7 +527,11 @@ void SVGParser::parseLine( XMLElement* xml, Line* line ) {
 
 void SVGParser::parsePolyline( XMLElement* xml, Polyline* polyline ) {
 
-  stringstream points (xml->Attribute( "points" ));
+  const char* data = xml->Attribute( "points" );
+  stringstream points (data);
+
+  // one separator per point
+  polyline->points.reserve( count( data, data + strlen( data ), ',' ) );
 
   float x, y;
   char c;
@@ -320,7 +550,11 @@ void SVGParser::parseRect( XMLElement* xml, Rect* rect ) {
 
 void SVGParser::parsePolygon( XMLElement* xml, Polygon* polygon ) {
 
-  stringstream points (xml->Attribute( "points" ));
+  const char* data = xml->Attribute( "points" );
+  stringstream points (data);
+
+  // one separator per point
+  polygon->points.reserve( count( data, data + strlen( data ), ',' ) );
 
   float x, y;
   char c;
@@ -338,6 +572,14 @@ void SVGParser::parseEllipse( XMLElement* xml, Ellipse* ellipse ) {
                              xml->FloatAttribute( "ry" ));
 }
 
+void SVGParser::parseCircle( XMLElement* xml, Ellipse* ellipse ) {
+  ellipse->center = Vector2D(xml->FloatAttribute( "cx" ),
+                             xml->FloatAttribute( "cy" ));
+
+  float r = xml->FloatAttribute( "r" );
+  ellipse->radius = Vector2D( r, r );
+}
+
 void SVGParser::parseImage( XMLElement* xml, Image* image ) {
   image->position  = Vector2D ( xml->FloatAttribute( "x" ),
                                 xml->FloatAttribute( "y" ));
@@ -374,88 +616,5 @@ void SVGParser::parseImage( XMLElement* xml, Image* image ) {
   image->tex.mipmap.push_back(mip_start);
 }
 
-void SVGParser::parseGroup( XMLElement* xml, Group* group ) {
-
-  /* NOTE (sky):
-   * A group contains a list of elements, and optionally a transformation
-   * to apply to all the elements it contains. Elements in a group follow
-   * the same draw order as elements in a svg (top to bottom).  
-   * A group should be considered as one single element outside its scope.
-   * This means at draw time, all elements in a group should be drawn before 
-   * elements outside the group. All elements in the group inherits the group
-   * transformation, and keep in mind that transformation is accumulative.
-   * Groups can also be nested.  
-   */
-  XMLElement* elem = xml->FirstChildElement();
-  while( elem ) {
-
-    string elementType ( elem->Value() );
-    if( elementType == "line" ) {
-
-      Line* line = new Line();
-      parseElement( elem, line );
-      parseLine( elem, line );
-      group->elements.push_back( line );
-    
-    } else if( elementType == "polyline" ) {
-
-      Polyline* polyline = new Polyline();
-      parseElement( elem, polyline );
-      parsePolyline( elem, polyline );
-      group->elements.push_back( polyline );
-
-    } else if( elementType == "rect" ) {
-
-      float w = elem->FloatAttribute("width" );
-      float h = elem->FloatAttribute("height");
-
-      // treat zero-size rectangles as points
-      if (w == 0 && h == 0) {
-        Point* point = new Point();
-        parseElement( elem, point );
-        parsePoint( elem, point );
-        group->elements.push_back( point );
-      } else {
-        Rect* rect = new Rect();
-        parseElement( elem, rect );
-        parseRect( elem, rect );
-        group->elements.push_back( rect );
-      }
-
-    } else if( elementType == "polygon" ) {
-    
-      Polygon* polygon = new Polygon();
-      parseElement( elem, polygon );
-      parsePolygon( elem, polygon );
-      group->elements.push_back( polygon );
-    
-    } else if( elementType == "ellipse" ) {
-    
-      Ellipse* ellipse = new Ellipse();
-      parseElement( elem, ellipse );
-      parseEllipse( elem, ellipse );
-      group->elements.push_back( ellipse );
-
-    } else if ( elementType == "image" ) {
-    
-      Image* image = new Image();
-      parseElement( elem, image );
-      parseImage( elem, image);
-      group->elements.push_back( image ); 
-    
-    } else if( elementType == "g" ) {
-    
-       Group* sub_group = new Group();
-       parseElement( elem, sub_group );
-       parseGroup( elem, sub_group );
-       group->elements.push_back( sub_group );
-    
-    } else {
-       // unknown element type --- include default handler here if desired
-    }    
-    elem = elem->NextSiblingElement();
-  }
-}
-
 } // namespace CMU462
 
@@ -3,6 +3,7 @@
 
 #include <map>
 #include <vector>
+#include <iosfwd>
 
 #include "color.h"
 #include "texture.h"
@@ -127,11 +128,19 @@ class SVGParser {
 
   static int load( const char* filename, SVG* svg );
   static int save( const char* filename, const SVG* svg );
+
+  // load a document held in memory (size bytes of xml text)
+  static int load( const char* data, size_t size, SVG* svg );
+
+  // deepest nesting of groups loaded, deeper documents are rejected
+  static const size_t kMaxGroupDepth = 256;
  
  private:
+
+  static int load( std::istream& in, SVG* svg );
   
-  // parse a svg file
-  static void parseSVG       ( XMLElement* xml, SVG* svg );
+  // create the svg element described by a xml element (nullptr if unknown)
+  static SVGElement* parseChild( XMLElement* xml );
 
   // parse shared properties of svg elements
   static void parseElement   ( XMLElement* xml, SVGElement* element );
@@ -143,8 +152,8 @@ class SVGParser {
   static void parseRect      ( XMLElement* xml, Rect*     rect        );
   static void parsePolygon   ( XMLElement* xml, Polygon*  polygon     );
   static void parseEllipse   ( XMLElement* xml, Ellipse*  ellipse     );
+  static void parseCircle    ( XMLElement* xml, Ellipse*  ellipse     );
   static void parseImage     ( XMLElement* xml, Image*    image       );
-  static void parseGroup     ( XMLElement* xml, Group*    group       );
 
 
 }; // class SVGParser
@@ -0,0 +1,464 @@
+#include "svg_binary.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <type_traits>
+
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+using namespace std;
+
+namespace CMU462 {
+
+namespace {
+
+const char kMagic[8] = { 'D', 'S', 'V', 'G', 'B', 0, 0, 0 };
+
+struct FileHeader {
+  char     magic[8];
+  uint32_t version;
+  uint32_t num_records;
+  float    width;
+  float    height;
+  uint64_t num_points;
+  uint64_t num_mips;
+  uint64_t num_texels;  // in bytes
+};
+
+// one element, groups are followed by their num_children direct children
+struct ElementRecord {
+  uint32_t type;
+  uint32_t num_children;
+  double   transform[9];  // row major
+  float    stroke[4];
+  float    fill[4];
+  float    stroke_width;
+  float    miter_limit;
+  float    geometry[4];   // position/dimension, from/to or center/radius
+  uint64_t first;         // first point (polyline, polygon) or mip (image)
+  uint64_t count;         // number of points or mip levels
+};
+
+struct MipRecord {
+  uint64_t width;
+  uint64_t height;
+  uint64_t first_texel;
+};
+
+static_assert(sizeof(FileHeader)    % 8 == 0, "sections must stay aligned");
+static_assert(sizeof(ElementRecord) % 8 == 0, "sections must stay aligned");
+static_assert(sizeof(MipRecord)     % 8 == 0, "sections must stay aligned");
+static_assert(sizeof(Vector2D) == 2 * sizeof(double) &&
+              is_standard_layout<Vector2D>::value,
+              "points are stored as raw Vector2D arrays");
+
+// read-only view of a whole file
+class MappedFile {
+ public:
+
+  ~MappedFile() {
+#ifndef _WIN32
+    if (data) munmap((void*) data, size);
+#endif
+  }
+
+  bool open( const char* filename ) {
+#ifdef _WIN32
+    ifstream in( filename, ios::binary );
+    if( !in.is_open() ) return false;
+    buffer.assign( istreambuf_iterator<char>(in), istreambuf_iterator<char>() );
+    data = (const unsigned char*) buffer.data();
+    size = buffer.size();
+    return true;
+#else
+    int fd = ::open( filename, O_RDONLY );
+    if( fd < 0 ) return false;
+    struct stat st;
+    if( fstat(fd, &st) < 0 || st.st_size == 0 ) { close(fd); return false; }
+    void* p = mmap( nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    close(fd);
+    if( p == MAP_FAILED ) return false;
+    data = (const unsigned char*) p;
+    size = st.st_size;
+    return true;
+#endif
+  }
+
+  const unsigned char* data = nullptr;
+  size_t size = 0;
+
+ private:
+
+#ifdef _WIN32
+  vector<char> buffer;
+#endif
+
+}; // class MappedFile
+
+// flattens an element tree into the record arrays
+struct Writer {
+
+  vector<ElementRecord> records;
+  vector<Vector2D>      points;
+  vector<MipRecord>     mips;
+  vector<unsigned char> texels;
+
+  void add_points( ElementRecord& r, const vector<Vector2D>& p ) {
+    r.first = points.size();
+    r.count = p.size();
+    points.insert( points.end(), p.begin(), p.end() );
+  }
+
+  void add_elements( const vector<SVGElement*>& elements ) {
+    for( const SVGElement* element : elements ) add_element( element );
+  }
+
+  void add_element( const SVGElement* element ) {
+
+    ElementRecord r;
+    memset( &r, 0, sizeof(r) );
+    r.type = element->type;
+    for( int i = 0; i < 3; ++i )
+      for( int j = 0; j < 3; ++j )
+        r.transform[i * 3 + j] = element->transform(i, j);
+
+    const Style& s = element->style;
+    r.stroke[0] = s.strokeColor.r; r.stroke[1] = s.strokeColor.g;
+    r.stroke[2] = s.strokeColor.b; r.stroke[3] = s.strokeColor.a;
+    r.fill[0]   = s.fillColor.r;   r.fill[1]   = s.fillColor.g;
+    r.fill[2]   = s.fillColor.b;   r.fill[3]   = s.fillColor.a;
+    r.stroke_width = s.strokeWidth;
+    r.miter_limit  = s.miterLimit;
+
+    switch( element->type ) {
+      case POINT: {
+        const Point* e = static_cast<const Point*>(element);
+        r.geometry[0] = e->position.x; r.geometry[1] = e->position.y;
+        break;
+      }
+      case LINE: {
+        const Line* e = static_cast<const Line*>(element);
+        r.geometry[0] = e->from.x; r.geometry[1] = e->from.y;
+        r.geometry[2] = e->to.x;   r.geometry[3] = e->to.y;
+        break;
+      }
+      case POLYLINE:
+        add_points( r, static_cast<const Polyline*>(element)->points );
+        break;
+      case POLYGON:
+        add_points( r, static_cast<const Polygon*>(element)->points );
+        break;
+      case RECT: {
+        const Rect* e = static_cast<const Rect*>(element);
+        r.geometry[0] = e->position.x;  r.geometry[1] = e->position.y;
+        r.geometry[2] = e->dimension.x; r.geometry[3] = e->dimension.y;
+        break;
+      }
+      case ELLIPSE: {
+        const Ellipse* e = static_cast<const Ellipse*>(element);
+        r.geometry[0] = e->center.x; r.geometry[1] = e->center.y;
+        r.geometry[2] = e->radius.x; r.geometry[3] = e->radius.y;
+        break;
+      }
+      case IMAGE: {
+        const Image* e = static_cast<const Image*>(element);
+        r.geometry[0] = e->position.x;  r.geometry[1] = e->position.y;
+        r.geometry[2] = e->dimension.x; r.geometry[3] = e->dimension.y;
+        r.first = mips.size();
+        r.count = e->tex.mipmap.size();
+        for( const MipLevel& level : e->tex.mipmap ) {
+          mips.push_back({ level.width, level.height, texels.size() });
+          texels.insert( texels.end(), level.texels.begin(), level.texels.end() );
+        }
+        break;
+      }
+      case GROUP:
+        r.num_children = static_cast<const Group*>(element)->elements.size();
+        break;
+      default:
+        break;
+    }
+
+    records.push_back( r );
+    if( element->type == GROUP ) {
+      add_elements( static_cast<const Group*>(element)->elements );
+    }
+  }
+
+}; // struct Writer
+
+// rebuilds the element tree from the mapped record arrays
+struct Reader {
+
+  const ElementRecord* records;
+  const Vector2D*      points;
+  const MipRecord*     mips;
+  const unsigned char* texels;
+  size_t num_records;
+  size_t num_points;
+  size_t num_mips;
+  size_t num_texels;
+  size_t cursor;
+
+  bool valid( const ElementRecord& r ) const {
+    switch( r.type ) {
+      case POLYLINE: case POLYGON:
+        return r.first <= num_points && r.count <= num_points - r.first;
+      case IMAGE:
+        if( r.first > num_mips || r.count > num_mips - r.first ) return false;
+        for( size_t i = 0; i < r.count; ++i ) {
+          // bound the dimensions one at a time so 4 * width * height
+          // cannot wrap around
+          const MipRecord& m = mips[r.first + i];
+          if( m.first_texel > num_texels ) return false;
+          uint64_t pixels = (num_texels - m.first_texel) / 4;
+          if( m.width && m.height > pixels / m.width ) return false;
+        }
+        return true;
+      default:
+        return true;
+    }
+  }
+
+  bool read_elements( size_t count, vector<SVGElement*>& elements,
+                      size_t depth ) {
+    if( count > num_records - cursor ) return false;
+    elements.reserve( count );
+    for( size_t i = 0; i < count; ++i ) {
+      SVGElement* element = read_element( records[cursor++], depth );
+      if( !element ) return false;
+      elements.push_back( element );
+    }
+    return true;
+  }
+
+  // depth is the number of groups around the element
+  SVGElement* read_element( const ElementRecord& r, size_t depth ) {
+
+    if( !valid(r) ) return nullptr;
+
+    SVGElement* element = nullptr;
+    switch( r.type ) {
+      case POINT: {
+        Point* e = new Point();
+        e->position = Vector2D( r.geometry[0], r.geometry[1] );
+        element = e;
+        break;
+      }
+      case LINE: {
+        Line* e = new Line();
+        e->from = Vector2D( r.geometry[0], r.geometry[1] );
+        e->to   = Vector2D( r.geometry[2], r.geometry[3] );
+        element = e;
+        break;
+      }
+      case POLYLINE: {
+        Polyline* e = new Polyline();
+        e->points.assign( points + r.first, points + r.first + r.count );
+        element = e;
+        break;
+      }
+      case POLYGON: {
+        Polygon* e = new Polygon();
+        e->points.assign( points + r.first, points + r.first + r.count );
+        element = e;
+        break;
+      }
+      case RECT: {
+        Rect* e = new Rect();
+        e->position  = Vector2D( r.geometry[0], r.geometry[1] );
+        e->dimension = Vector2D( r.geometry[2], r.geometry[3] );
+        element = e;
+        break;
+      }
+      case ELLIPSE: {
+        Ellipse* e = new Ellipse();
+        e->center = Vector2D( r.geometry[0], r.geometry[1] );
+        e->radius = Vector2D( r.geometry[2], r.geometry[3] );
+        element = e;
+        break;
+      }
+      case IMAGE: {
+        Image* e = new Image();
+        e->position  = Vector2D( r.geometry[0], r.geometry[1] );
+        e->dimension = Vector2D( r.geometry[2], r.geometry[3] );
+        e->tex.mipmap.resize( r.count );
+        for( size_t i = 0; i < r.count; ++i ) {
+          const MipRecord& m = mips[r.first + i];
+          MipLevel& level = e->tex.mipmap[i];
+          level.width  = m.width;
+          level.height = m.height;
+          level.texels.assign( texels + m.first_texel,
+                               texels + m.first_texel + 4 * m.width * m.height );
+        }
+        e->tex.width  = r.count ? e->tex.mipmap[0].width  : 0;
+        e->tex.height = r.count ? e->tex.mipmap[0].height : 0;
+        element = e;
+        break;
+      }
+      case GROUP: {
+        if( depth >= SVGParser::kMaxGroupDepth ) return nullptr;
+        Group* e = new Group();
+        if( !read_elements( r.num_children, e->elements, depth + 1 ) ) {
+          delete e;
+          return nullptr;
+        }
+        element = e;
+        break;
+      }
+      default:
+        return nullptr;
+    }
+
+    element->transform = Matrix3x3( const_cast<double*>(r.transform) );
+    element->style.strokeColor = Color( r.stroke[0], r.stroke[1],
+                                        r.stroke[2], r.stroke[3] );
+    element->style.fillColor   = Color( r.fill[0], r.fill[1],
+                                        r.fill[2], r.fill[3] );
+    element->style.strokeWidth = r.stroke_width;
+    element->style.miterLimit  = r.miter_limit;
+    return element;
+  }
+
+}; // struct Reader
+
+} // namespace
+
+int SVGBinaryParser::load( const char* filename, SVG* svg ) {
+
+  MappedFile file;
+  if( !file.open( filename ) ) {
+    return -1;
+  }
+
+  // validate header
+  FileHeader header;
+  if( file.size < sizeof(header) ) {
+    cerr << "Error: truncated compiled svg " << filename << endl;
+    return -1;
+  }
+  memcpy( &header, file.data, sizeof(header) );
+  if( memcmp( header.magic, kMagic, sizeof(kMagic) ) ) {
+    cerr << "Error: not a compiled svg file!" << endl;
+    return -1;
+  }
+  if( header.version != kVersion ) {
+    cerr << "Error: compiled svg version " << header.version
+         << " (expected " << kVersion << "), please recompile" << endl;
+    return -1;
+  }
+
+  // locate sections
+  if( header.num_points > file.size || header.num_mips > file.size ||
+      header.num_texels > file.size ) {
+    cerr << "Error: corrupted compiled svg " << filename << endl;
+    return -1;
+  }
+  size_t records_offset = sizeof(FileHeader);
+  size_t points_offset  = records_offset + header.num_records * sizeof(ElementRecord);
+  size_t mips_offset    = points_offset  + header.num_points  * sizeof(Vector2D);
+  size_t texels_offset  = mips_offset    + header.num_mips    * sizeof(MipRecord);
+  if( texels_offset + header.num_texels != file.size ) {
+    cerr << "Error: corrupted compiled svg " << filename << endl;
+    return -1;
+  }
+
+  Reader reader;
+  reader.records = (const ElementRecord*) (file.data + records_offset);
+  reader.points  = (const Vector2D*)      (file.data + points_offset);
+  reader.mips    = (const MipRecord*)     (file.data + mips_offset);
+  reader.texels  = file.data + texels_offset;
+  reader.num_records = header.num_records;
+  reader.num_points  = header.num_points;
+  reader.num_mips    = header.num_mips;
+  reader.num_texels  = header.num_texels;
+  reader.cursor = 0;
+
+  svg->width  = header.width;
+  svg->height = header.height;
+  while( reader.cursor < reader.num_records ) {
+    SVGElement* element = reader.read_element( reader.records[reader.cursor++], 0 );
+    if( !element ) {
+      cerr << "Error: corrupted compiled svg " << filename << endl;
+      return -1;
+    }
+    svg->elements.push_back( element );
+  }
+
+  return 0;
+}
+
+int SVGBinaryParser::load_file( const char* filename, SVG* svg ) {
+
+  size_t n = strlen( filename );
+  if( n >= 6 && !strcmp( filename + n - 6, ".dsvgb" ) ) {
+    return load( filename, svg );
+  }
+
+  // a compiled scene that fails to load leaves the xml to parse
+  string compiled = compiled_path( filename );
+  if( !compiled.empty() ) {
+    if( load( compiled.c_str(), svg ) == 0 ) return 0;
+    for( size_t i = 0; i < svg->elements.size(); ++i ) {
+      delete svg->elements[i];
+    }
+    svg->elements.clear();
+  }
+  return SVGParser::load( filename, svg );
+}
+
+string SVGBinaryParser::compiled_path( const string& filename ) {
+
+  size_t n = filename.size();
+  if( n < 4 || filename.compare( n - 4, 4, ".svg" ) ) return string();
+  string compiled = filename.substr( 0, n - 4 ) + ".dsvgb";
+
+  // an edited svg is newer than the scene compiled from it
+  struct stat source, target;
+  if( stat( filename.c_str(), &source ) || stat( compiled.c_str(), &target ) ||
+      target.st_mtime < source.st_mtime ) return string();
+  return compiled;
+}
+
+int SVGBinaryParser::save( const char* filename, const SVG* svg ) {
+
+  Writer writer;
+  writer.add_elements( svg->elements );
+
+  FileHeader header;
+  memset( &header, 0, sizeof(header) );
+  memcpy( header.magic, kMagic, sizeof(kMagic) );
+  header.version     = kVersion;
+  header.num_records = writer.records.size();
+  header.width       = svg->width;
+  header.height      = svg->height;
+  header.num_points  = writer.points.size();
+  header.num_mips    = writer.mips.size();
+  header.num_texels  = writer.texels.size();
+
+  ofstream out( filename, ios::binary | ios::trunc );
+  if( !out.is_open() ) {
+    return -1;
+  }
+
+  out.write( (const char*) &header, sizeof(header) );
+  out.write( (const char*) writer.records.data(),
+             writer.records.size() * sizeof(ElementRecord) );
+  out.write( (const char*) writer.points.data(),
+             writer.points.size() * sizeof(Vector2D) );
+  out.write( (const char*) writer.mips.data(),
+             writer.mips.size() * sizeof(MipRecord) );
+  out.write( (const char*) writer.texels.data(), writer.texels.size() );
+
+  return out.good() ? 0 : -1;
+}
+
+} // namespace CMU462
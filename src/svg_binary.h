@@ -0,0 +1,45 @@
+#ifndef CMU462_SVG_BINARY_H
+#define CMU462_SVG_BINARY_H
+
+#include <string>
+
+#include "svg.h"
+
+namespace CMU462 {
+
+/**
+ * Precompiled svg scene (.dsvgb).
+ * The file stores a parsed SVG as flat arrays: one record per element in
+ * document (pre-)order, followed by the point arrays of all polylines and
+ * polygons, the mip level descriptions of all images and finally the texels
+ * of every mip level. Loading a compiled scene maps the file into memory and
+ * copies each array out in bulk, skipping xml parsing, base64/png decoding
+ * and mipmap generation entirely.
+ */
+class SVGBinaryParser {
+ public:
+
+  // version of the binary layout, bump when any record changes
+  static const uint32_t kVersion = 2;
+
+  static int load( const char* filename, SVG* svg );
+  static int save( const char* filename, const SVG* svg );
+
+  /**
+   * Load a svg or compiled scene file. A .svg with a compiled scene of the
+   * same name next to it (foo.svg and foo.dsvgb) that is at least as new is
+   * loaded from the compiled scene, falling back to the xml if that fails.
+   */
+  static int load_file( const char* filename, SVG* svg );
+
+  /**
+   * The up to date compiled scene load_file takes a .svg from, empty if
+   * there is none.
+   */
+  static std::string compiled_path( const std::string& filename );
+
+}; // class SVGBinaryParser
+
+} // namespace CMU462
+
+#endif // CMU462_SVG_BINARY_H
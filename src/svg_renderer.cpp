@@ -0,0 +1,49 @@
+#include "svg_renderer.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define DRAWSVG_SSE2
+#endif
+
+namespace CMU462 {
+
+static_assert(sizeof(Vector2D) == 2 * sizeof(double),
+              "points are read as packed (x, y) pairs");
+
+void SVGRenderer::transform(const Matrix3x3 &t,
+                            const Vector2D *in, Vector2D *out, size_t n) {
+
+  if (!is_affine(t)) {
+    for (size_t i = 0; i < n; ++i) out[i] = transform(t, in[i]);
+    return;
+  }
+
+  // the last row only scales, fold it into the first two
+  double s = 1.0 / t(2, 2);
+  double m00 = t(0, 0) * s, m01 = t(0, 1) * s, m02 = t(0, 2) * s;
+  double m10 = t(1, 0) * s, m11 = t(1, 1) * s, m12 = t(1, 2) * s;
+
+#ifdef DRAWSVG_SSE2
+  // one point per register: (x, y) = x * col0 + y * col1 + col2
+  const __m128d c0 = _mm_set_pd(m10, m00);
+  const __m128d c1 = _mm_set_pd(m11, m01);
+  const __m128d c2 = _mm_set_pd(m12, m02);
+  const double *src = &in[0].x;
+  double *dst = &out[0].x;
+  for (size_t i = 0; i < n; ++i, src += 2, dst += 2) {
+    __m128d x = _mm_set1_pd(src[0]);
+    __m128d y = _mm_set1_pd(src[1]);
+    __m128d p = _mm_add_pd(_mm_add_pd(_mm_mul_pd(x, c0), _mm_mul_pd(y, c1)), c2);
+    _mm_storeu_pd(dst, p);
+  }
+#else
+  for (size_t i = 0; i < n; ++i) {
+    double x = in[i].x, y = in[i].y;
+    out[i].x = m00 * x + m01 * y + m02;
+    out[i].y = m10 * x + m11 * y + m12;
+  }
+#endif
+
+}
+
+} // namespace CMU462
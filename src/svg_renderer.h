@@ -47,6 +47,16 @@ class SVGRenderer {
     return {u.x / u.z, u.y / u.z};
   }
 
+  // Transform n points at once (in and out may alias), affine matrices skip
+  // the perspective divide
+  static void transform(const Matrix3x3 &t,
+                        const Vector2D *in, Vector2D *out, size_t n);
+
+  // Whether the last row of t is (0, 0, w) for some w != 0
+  static inline bool is_affine(const Matrix3x3 &t) {
+    return t(2, 0) == 0 && t(2, 1) == 0 && t(2, 2) != 0;
+  }
+
 };
 
 } // namespace CMU462
@@ -0,0 +1,145 @@
+#include "tab_manager.h"
+#include "svg_binary.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace CMU462 {
+
+namespace {
+
+// rough heap footprint of the elements, dominated by texels and points
+size_t element_bytes( const vector<SVGElement*>& elements ) {
+
+  size_t bytes = elements.capacity() * sizeof(SVGElement*);
+  for( size_t i = 0; i < elements.size(); ++i ) {
+    SVGElement* element = elements[i];
+    switch( element->type ) {
+      case POLYLINE:
+        bytes += sizeof(Polyline) + static_cast<Polyline*>(element)->points.capacity() * sizeof(Vector2D);
+        break;
+      case POLYGON:
+        bytes += sizeof(Polygon) + static_cast<Polygon*>(element)->points.capacity() * sizeof(Vector2D);
+        break;
+      case IMAGE: {
+        const Texture& tex = static_cast<Image*>(element)->tex;
+        bytes += sizeof(Image);
+        for( size_t j = 0; j < tex.mipmap.size(); ++j ) {
+          bytes += sizeof(MipLevel) + tex.mipmap[j].texels.capacity();
+        }
+        break;
+      }
+      case GROUP:
+        bytes += sizeof(Group) + element_bytes(static_cast<Group*>(element)->elements);
+        break;
+      case POINT:   bytes += sizeof(Point);   break;
+      case LINE:    bytes += sizeof(Line);    break;
+      case RECT:    bytes += sizeof(Rect);    break;
+      case ELLIPSE: bytes += sizeof(Ellipse); break;
+      default: break;
+    }
+  }
+  return bytes;
+}
+
+} // namespace
+
+TabManager::TabManager()
+    : budget( size_t(512) << 20 ), resident( 0 ), clock( 0 ) { }
+
+TabManager::~TabManager() {
+  for( size_t i = 0; i < tabs.size(); ++i ) {
+    delete tabs[i].svg;
+  }
+}
+
+void TabManager::add( SVG* svg, const string& path ) {
+
+  Tab tab = { svg, path, 0, 0 };
+  tabs.push_back( tab );
+  update_size( tabs.size() - 1 );
+}
+
+void TabManager::add( const string& path ) {
+
+  Tab tab = { nullptr, path, 0, 0 };
+  tabs.push_back( tab );
+}
+
+void TabManager::remove( size_t index ) {
+
+  if( index >= tabs.size() ) return;
+  resident -= tabs[index].bytes;
+  delete tabs[index].svg;
+  tabs.erase( tabs.begin() + index );
+}
+
+SVG* TabManager::acquire( size_t index, bool* loaded ) {
+
+  if( loaded ) *loaded = false;
+  if( index >= tabs.size() ) return nullptr;
+
+  Tab& tab = tabs[index];
+  tab.last_use = ++clock;
+  if( tab.svg ) return tab.svg;
+
+  // precompiled scenes (also those compiled from the tab's svg) skip xml
+  // parsing and mipmap generation
+  SVG* svg = new SVG();
+  if( SVGBinaryParser::load_file( tab.path.c_str(), svg ) < 0 ) {
+    delete svg;
+    return nullptr;
+  }
+
+  tab.svg = svg;
+  update_size( index );
+  if( loaded ) *loaded = true;
+  return svg;
+}
+
+bool TabManager::adopt( size_t index, SVG* svg ) {
+
+  if( index >= tabs.size() || tabs[index].svg ) return false;
+  tabs[index].svg = svg;
+  update_size( index );
+  return true;
+}
+
+void TabManager::update_size( size_t index ) {
+
+  Tab& tab = tabs[index];
+  resident -= tab.bytes;
+  tab.bytes = tab.svg ? measure( *tab.svg ) : 0;
+  resident += tab.bytes;
+}
+
+size_t TabManager::measure( const SVG& svg ) {
+  return sizeof(SVG) + element_bytes( svg.elements );
+}
+
+vector<SVG*> TabManager::trim( size_t keep, size_t extra ) {
+
+  vector<SVG*> released;
+  if( resident + extra <= budget ) return released;
+
+  // candidates oldest first, tabs without a file can not come back
+  vector<size_t> order;
+  for( size_t i = 0; i < tabs.size(); ++i ) {
+    if( i != keep && tabs[i].svg && !tabs[i].path.empty() ) order.push_back( i );
+  }
+  sort( order.begin(), order.end(), [this]( size_t a, size_t b ) {
+    return tabs[a].last_use < tabs[b].last_use;
+  });
+
+  for( size_t i = 0; i < order.size() && resident + extra > budget; ++i ) {
+    Tab& tab = tabs[order[i]];
+    released.push_back( tab.svg );
+    resident -= tab.bytes;
+    tab.svg = nullptr;
+    tab.bytes = 0;
+  }
+  return released;
+}
+
+} // namespace CMU462
@@ -0,0 +1,107 @@
+#ifndef CMU462_TAB_MANAGER_H
+#define CMU462_TAB_MANAGER_H
+
+#include <string>
+#include <vector>
+
+#include "svg.h"
+
+namespace CMU462 {
+
+/**
+ * The svgs behind the viewer tabs.
+ * Tabs opened from a file remember their path, so while inactive their svg
+ * (with its decoded images and mip chains) can be released and loaded again
+ * when the tab is shown. Whenever the resident svgs exceed the memory cap,
+ * the least recently used ones are released first. Tabs handed an svg
+ * without a path stay resident. Tabs own their svgs.
+ */
+class TabManager {
+ public:
+
+  TabManager();
+  ~TabManager();
+
+  inline size_t size() const { return tabs.size(); }
+
+  /**
+   * Append a tab. An svg given with the path it was loaded from may be
+   * released later, a path alone is loaded on first use.
+   */
+  void add( SVG* svg, const std::string& path = "" );
+  void add( const std::string& path );
+
+  /**
+   * Remove a tab and delete its svg.
+   */
+  void remove( size_t index );
+
+  /**
+   * The svg of a tab, nullptr while it is released.
+   */
+  inline SVG* svg( size_t index ) const { return tabs[index].svg; }
+  inline const std::string& path( size_t index ) const {
+    return tabs[index].path;
+  }
+
+  /**
+   * Make a tab resident and mark it as the most recently used. Sets loaded
+   * if the svg had to be loaded, from an up to date compiled scene next to
+   * its file if there is one (see SVGBinaryParser::load_file). Returns
+   * nullptr if its file can not be loaded.
+   */
+  SVG* acquire( size_t index, bool* loaded = nullptr );
+
+  /**
+   * Hand a released tab the svg loaded from its file elsewhere, the tab owns
+   * it from then on. Returns false (keeping nothing) if the tab is resident.
+   */
+  bool adopt( size_t index, SVG* svg );
+
+  /**
+   * Measure a tab again after its svg changed, e.g. mipmaps were generated.
+   */
+  void update_size( size_t index );
+
+  /**
+   * Heap memory of an svg as counted against the budget.
+   */
+  static size_t measure( const SVG& svg );
+
+  /**
+   * Cap on the memory of all resident svgs, in bytes (512MB by default).
+   * Only svg memory is capped: elements, point arrays and mip chains as
+   * measure counts them. Frames cached for the tabs, the renderers' stroke
+   * meshes and sample buffers and the hardware renderer's textures come on
+   * top and are bounded by their owners.
+   */
+  inline void set_budget( size_t bytes ) { budget = bytes; }
+  inline size_t get_budget() const { return budget; }
+  inline size_t resident_bytes() const { return resident; }
+
+  /**
+   * Release the least recently used tabs other than keep until the resident
+   * svgs, plus extra bytes of svgs held elsewhere (e.g. loaded in the
+   * background), fit the budget. The released svgs are handed back for the
+   * caller to delete once nothing refers to them anymore.
+   */
+  std::vector<SVG*> trim( size_t keep, size_t extra = 0 );
+
+ private:
+
+  struct Tab {
+    SVG* svg;
+    std::string path;
+    size_t bytes;
+    size_t last_use;
+  };
+
+  std::vector<Tab> tabs;
+  size_t budget, resident;
+  size_t clock;
+
+}; // class TabManager
+
+} // namespace CMU462
+
+#endif // CMU462_TAB_MANAGER_H
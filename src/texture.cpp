@@ -25,6 +25,8 @@ inline void float_to_uint8(unsigned char *dst, float src[4]) {
   dst_uint8[3] = (uint8_t) (255.f * max(0.0f, min(1.0f, src[3])));
 }
 
+Sampler2D::~Sampler2D() {}
+
 void Sampler2DImp::generate_mips(Texture &tex, int startLevel) {
 
   // NOTE: 
@@ -109,7 +111,7 @@ Color Sampler2DImp::sample_bilinear(Texture &tex,
                                     int level) {
 
   // Task 6: Implement bilinear filtering
-  auto mipmap = tex.mipmap[level];
+  auto &mipmap = tex.mipmap[level];
   u *= float(mipmap.width);
   v *= float(mipmap.height);
   if (0 > u || u >= mipmap.width || 0 > v || v >= mipmap.height)
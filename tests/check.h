@@ -0,0 +1,21 @@
+#ifndef DRAWSVG_TESTS_CHECK_H
+#define DRAWSVG_TESTS_CHECK_H
+
+#include <cstdio>
+
+// failed checks are reported and counted, a test program exits with 1 if
+// any failed
+static int check_failures = 0;
+
+#define CHECK( condition ) \
+  do { \
+    if( !(condition) ) { \
+      fprintf( stderr, "%s:%d: check failed: %s\n", \
+               __FILE__, __LINE__, #condition ); \
+      ++check_failures; \
+    } \
+  } while( 0 )
+
+#define CHECK_RESULT() ( check_failures ? 1 : 0 )
+
+#endif // DRAWSVG_TESTS_CHECK_H
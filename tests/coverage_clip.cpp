@@ -0,0 +1,81 @@
+// Coverage AA on shapes crossing the left border of the target. The edge
+// walk used to drift past the border and write before the accumulation
+// buffer, which shows under ASan or as a corrupted heap.
+
+#include "check.h"
+#include "offscreen_renderer.h"
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+
+using namespace CMU462;
+
+// fixed sequence of numbers in [a, b), the same on every platform
+static float next_float( uint32_t& state, float a, float b ) {
+  state = state * 1664525u + 1013904223u;
+  return a + (b - a) * float(state >> 8) / float(1u << 24);
+}
+
+int main() {
+
+  const size_t w = 100, h = 100;
+  std::vector<unsigned char> pixels( 4 * w * h );
+
+  // a quad straddling x = 0, filled up to the border at every sub-pixel shift
+  const char* quad =
+    "<svg width=\"100\" height=\"100\">"
+    "<polygon points=\"-30,10 40,20 35,45 -25,40\" fill=\"#000000\"/>"
+    "</svg>";
+
+  OffscreenRenderer renderer;
+  CHECK( renderer.load( quad, std::string( quad ).size() ) == 0 );
+  renderer.set_size( w, h );
+  renderer.set_aa_method( COVERAGE );
+  renderer.set_canvas_outline( false );
+
+  for( int i = -9; i <= 9; ++i ) {
+    Matrix3x3 m = Matrix3x3::identity();
+    m(0, 2) = 0.1 * i + 0.013;
+    m(1, 2) = 0.07 * i;
+    renderer.set_transform( m );
+    CHECK( renderer.render( &pixels[0] ) == 0 );
+
+    const unsigned char* inside = &pixels[4 * (30 * w + 0)];
+    const unsigned char* outside = &pixels[4 * (30 * w + 80)];
+    CHECK( inside[0] == 0 && inside[1] == 0 && inside[2] == 0 );
+    CHECK( outside[0] == 255 && outside[1] == 255 && outside[2] == 255 );
+  }
+
+  // many translucent triangles with edges running into the left border
+  std::string triangles = "<svg width=\"100\" height=\"100\">";
+  uint32_t state = 1;
+  for( int i = 0; i < 200; ++i ) {
+    char polygon[160];
+    float x0 = next_float( state, -60, 0 ), y0 = next_float( state, 0, 100 );
+    float x1 = next_float( state, 0, 100 ), y1 = next_float( state, 0, 100 );
+    float x2 = next_float( state, -60, 100 ), y2 = next_float( state, 0, 100 );
+    snprintf( polygon, sizeof(polygon),
+              "<polygon points=\"%f,%f %f,%f %f,%f\" fill=\"#000000\" "
+              "fill-opacity=\"0.1\"/>", x0, y0, x1, y1, x2, y2 );
+    triangles += polygon;
+  }
+  triangles += "</svg>";
+
+  CHECK( renderer.load( triangles.data(), triangles.size() ) == 0 );
+  for( int i = 0; i < 50; ++i ) {
+    Matrix3x3 m = Matrix3x3::identity();
+    m(0, 2) = 0.0173 * i;
+    m(1, 2) = 0.031 * i;
+    renderer.set_transform( m );
+    CHECK( renderer.render( &pixels[0] ) == 0 );
+  }
+
+  // tiles put the borders of the buffer inside the shapes
+  const char* path = "test_coverage_clip.png";
+  CHECK( renderer.render_png( path, 16 ) == 0 );
+  remove( path );
+
+  return CHECK_RESULT();
+}
@@ -0,0 +1,162 @@
+// The hardware renderer's retained vertex buffers draw a small scene like
+// the software renderer does, and editing an element of one document only
+// rebuilds that document's buffers. Runs headless on an EGL surfaceless
+// context (Mesa llvmpipe), exits with 77 (skipped) without one.
+
+#include "check.h"
+#include "GL/glew.h"
+#include "hardware_renderer.h"
+#include "offscreen_renderer.h"
+#include "image_metrics.h"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+
+using namespace CMU462;
+
+static const int kSkipped = 77;
+
+// compatibility profile context without a window, false if there is none
+static bool make_context() {
+  PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+    (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress( "eglGetPlatformDisplayEXT" );
+  if( !get_platform_display ) return false;
+  EGLDisplay display = get_platform_display( EGL_PLATFORM_SURFACELESS_MESA,
+                                             EGL_DEFAULT_DISPLAY, nullptr );
+  if( display == EGL_NO_DISPLAY ) return false;
+  if( !eglInitialize( display, nullptr, nullptr ) ) return false;
+  if( !eglBindAPI( EGL_OPENGL_API ) ) return false;
+  EGLContext context = eglCreateContext( display, EGL_NO_CONFIG_KHR,
+                                         EGL_NO_CONTEXT, nullptr );
+  if( context == EGL_NO_CONTEXT ) return false;
+  return eglMakeCurrent( display, EGL_NO_SURFACE, EGL_NO_SURFACE, context );
+}
+
+static const size_t w = 96, h = 72;
+
+// framebuffer contents, top row first
+static void read_pixels( std::vector<unsigned char>& pixels ) {
+  std::vector<unsigned char> rows( 4 * w * h );
+  glReadPixels( 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, &rows[0] );
+  pixels.resize( 4 * w * h );
+  for( size_t y = 0; y < h; ++y ) {
+    memcpy( &pixels[4 * y * w], &rows[4 * (h - 1 - y) * w], 4 * w );
+  }
+}
+
+int main() {
+
+  if( !make_context() ) {
+    printf( "skipped: no OpenGL context\n" );
+    return kSkipped;
+  }
+  glewExperimental = GL_TRUE;
+  glewInit();
+  if( !GLEW_VERSION_2_1 || !glGenFramebuffers ) {
+    printf( "skipped: OpenGL 2.1 and framebuffer objects are needed\n" );
+    return kSkipped;
+  }
+
+  GLuint framebuffer, renderbuffer;
+  glGenFramebuffers( 1, &framebuffer );
+  glBindFramebuffer( GL_FRAMEBUFFER, framebuffer );
+  glGenRenderbuffers( 1, &renderbuffer );
+  glBindRenderbuffer( GL_RENDERBUFFER, renderbuffer );
+  glRenderbufferStorage( GL_RENDERBUFFER, GL_RGBA8, w, h );
+  glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                             GL_RENDERBUFFER, renderbuffer );
+  CHECK( glCheckFramebufferStatus( GL_FRAMEBUFFER ) == GL_FRAMEBUFFER_COMPLETE );
+
+  // overlapping fills, outlines and a polyline, so that paint order and
+  // both triangles and lines go through the batch
+  const char* doc =
+    "<svg width=\"96\" height=\"72\">"
+    "<rect x=\"8\" y=\"8\" width=\"40\" height=\"30\" fill=\"#ff0000\"/>"
+    "<polygon points=\"30,20 80,12 70,60 20,50\" fill=\"#0000ff\" stroke=\"#000000\"/>"
+    "<g transform=\"translate(10,40)\">"
+    "<rect x=\"0\" y=\"0\" width=\"20\" height=\"20\" fill=\"#00ff00\" stroke=\"#ff00ff\"/>"
+    "</g>"
+    "<polyline points=\"4,66 30,58 60,68 92,56\" fill=\"none\" stroke=\"#000000\"/>"
+    "</svg>";
+
+  // the same view for both renderers
+  Matrix3x3 view = Matrix3x3::identity();
+  view(0, 0) = view(1, 1) = 0.9;
+  view(0, 2) = 4.25;
+  view(1, 2) = 3.5;
+
+  OffscreenRenderer software;
+  CHECK( software.load( doc, std::string( doc ).size() ) == 0 );
+  software.set_size( w, h );
+  software.set_transform( view );
+
+  SVG first, second;
+  CHECK( SVGParser::load( doc, std::string( doc ).size(), &first ) == 0 );
+  CHECK( SVGParser::load( doc, std::string( doc ).size(), &second ) == 0 );
+
+  HardwareRenderer* renderer = new HardwareRenderer();
+  renderer->resize( w, h );
+  renderer->set_svg_2_screen( view );
+  glViewport( 0, 0, w, h );
+
+  auto draw = [&]( SVG& svg, std::vector<unsigned char>& pixels ) {
+    renderer->clear_target();
+    renderer->draw_svg( svg );
+    read_pixels( pixels );
+  };
+
+  // pixels only differ where GL and the software rasterizer step lines
+  // differently
+  std::vector<unsigned char> expected( 4 * w * h ), actual, again, other;
+  CHECK( software.render( &expected[0] ) == 0 );
+  draw( first, actual );
+  ImageMetrics metrics = compare_images( &expected[0], &actual[0], w, h, 8 );
+  CHECK( metrics.error_count <= w * h / 100 );
+  CHECK( glGetError() == GL_NO_ERROR );
+
+  // drawn again from the same buffers
+  draw( first, again );
+  CHECK( again == actual );
+
+  // a document drawn from its own buffers
+  draw( second, other );
+  CHECK( other == actual );
+
+  // move the green square of both documents but only mark the first one:
+  // its buffers are rebuilt, those of the second stay as they were
+  for( SVG* svg : { &first, &second } ) {
+    Matrix3x3& transform = svg->elements[2]->transform;
+    transform(0, 2) += 40;
+    transform(1, 2) -= 4;
+  }
+  Matrix3x3& moved = software.svg()->elements[2]->transform;
+  moved(0, 2) += 40;
+  moved(1, 2) -= 4;
+  renderer->mark_dirty( first, first.elements[2] );
+
+  CHECK( software.render( &expected[0] ) == 0 );
+  draw( first, actual );
+  metrics = compare_images( &expected[0], &actual[0], w, h, 8 );
+  CHECK( metrics.error_count <= w * h / 100 );
+  CHECK( actual != again );
+
+  draw( second, other );
+  CHECK( other == again );
+
+  // and only marking it rebuilds the second document as well
+  renderer->mark_dirty( second, second.elements[2] );
+  draw( second, other );
+  CHECK( other == actual );
+
+  renderer->forget_svg( first );
+  renderer->forget_svg( second );
+  delete renderer;
+  CHECK( glGetError() == GL_NO_ERROR );
+
+  return CHECK_RESULT();
+}
@@ -0,0 +1,189 @@
+// The vectorized image comparison gives the same metrics as a plain per pixel
+// reference: identical, slightly different, random and opposite images with
+// widths and heights that leave partial registers and partial ssim windows,
+// a band long enough to flush the squared sums, every tolerance boundary and
+// a diff written in place over one of the inputs.
+
+#include "check.h"
+#include "image_metrics.h"
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+
+using namespace CMU462;
+
+// fixed sequence of bytes, the same on every platform
+static unsigned char next_byte( uint32_t& state ) {
+  state = state * 1664525u + 1013904223u;
+  return state >> 24;
+}
+
+static double luma( const unsigned char* p ) {
+  return (77 * p[0] + 150 * p[1] + 29 * p[2] + 128) >> 8;
+}
+
+// the metrics as documented, one pixel and one window at a time
+static ImageMetrics reference( const unsigned char* a, const unsigned char* b,
+                               size_t width, size_t height, int tolerance,
+                               std::vector<unsigned char>& diff ) {
+
+  ImageMetrics metrics;
+  metrics.tolerance = tolerance;
+  diff.assign( 4 * width * height, 0 );
+  double sum = 0, sum_squares = 0;
+  for( size_t i = 0; i < width * height; ++i ) {
+    bool over = false;
+    for( int k = 0; k < 3; ++k ) {
+      int d = abs( a[4 * i + k] - b[4 * i + k] );
+      metrics.max_error = std::max( metrics.max_error, d );
+      sum += d;
+      sum_squares += d * d;
+      over |= d > tolerance;
+      diff[4 * i + k] = d;
+    }
+    diff[4 * i + 3] = 255;
+    metrics.error_count += over;
+  }
+
+  double samples = 3.0 * width * height;
+  double mse = sum_squares / samples;
+  metrics.mean_error = sum / samples;
+  metrics.psnr = mse > 0 ? 10 * log10( 255 * 255 / mse ) : INFINITY;
+
+  // windows of 8x8, cut short at the right and bottom edges, weighted by
+  // the pixels they cover
+  const double c1 = (0.01 * 255) * (0.01 * 255), c2 = (0.03 * 255) * (0.03 * 255);
+  double total = 0;
+  for( size_t y0 = 0; y0 < height; y0 += 8 ) {
+    for( size_t x0 = 0; x0 < width; x0 += 8 ) {
+      double n = 0, sa = 0, sb = 0, saa = 0, sbb = 0, sab = 0;
+      for( size_t y = y0; y < std::min( y0 + 8, height ); ++y ) {
+        for( size_t x = x0; x < std::min( x0 + 8, width ); ++x ) {
+          double va = luma( a + 4 * (y * width + x) );
+          double vb = luma( b + 4 * (y * width + x) );
+          n += 1;
+          sa += va; sb += vb;
+          saa += va * va; sbb += vb * vb; sab += va * vb;
+        }
+      }
+      double ma = sa / n, mb = sb / n;
+      double va = saa / n - ma * ma, vb = sbb / n - mb * mb;
+      double cov = sab / n - ma * mb;
+      total += n * ((2 * ma * mb + c1) * (2 * cov + c2)) /
+                   ((ma * ma + mb * mb + c1) * (va + vb + c2));
+    }
+  }
+  metrics.ssim = total / (width * height);
+  return metrics;
+}
+
+static bool close( double x, double y ) {
+  if( std::isinf( x ) || std::isinf( y ) ) return x == y;
+  return fabs( x - y ) <= 1e-9 * std::max( 1.0, fabs( y ) );
+}
+
+static int compared = 0;
+
+// compare a against b every way compare_images can be called
+static void compare( const std::vector<unsigned char>& a,
+                     const std::vector<unsigned char>& b,
+                     size_t width, size_t height ) {
+
+  for( int tolerance : { 0, 1, 7, 254, 255 } ) {
+    std::vector<unsigned char> expected_diff;
+    ImageMetrics expected = reference( &a[0], &b[0], width, height,
+                                       tolerance, expected_diff );
+
+    std::vector<unsigned char> diff( a.size(), 0x55 );
+    ImageMetrics actual = compare_images( &a[0], &b[0], width, height,
+                                          tolerance, &diff[0] );
+    bool same = actual.max_error == expected.max_error &&
+                actual.error_count == expected.error_count &&
+                actual.tolerance == expected.tolerance &&
+                close( actual.mean_error, expected.mean_error ) &&
+                close( actual.psnr, expected.psnr ) &&
+                close( actual.ssim, expected.ssim ) &&
+                diff == expected_diff;
+
+    // without a diff, and with the diff written over the first image
+    ImageMetrics plain = compare_images( &a[0], &b[0], width, height, tolerance );
+    std::vector<unsigned char> in_place = a;
+    ImageMetrics over = compare_images( &in_place[0], &b[0], width, height,
+                                        tolerance, &in_place[0] );
+    for( const ImageMetrics* m : { &plain, &over } ) {
+      same &= m->max_error == actual.max_error &&
+              m->error_count == actual.error_count &&
+              m->mean_error == actual.mean_error &&
+              m->psnr == actual.psnr && m->ssim == actual.ssim;
+    }
+    same &= in_place == expected_diff;
+
+    if( !same ) {
+      fprintf( stderr, "%zux%zu tolerance %d: %s, expected %s\n",
+               width, height, tolerance, actual.summary().c_str(),
+               expected.summary().c_str() );
+    }
+    CHECK( same );
+    ++compared;
+  }
+}
+
+int main() {
+
+  // widths around the 4 pixel registers and 8 pixel windows, heights
+  // around the 8 row bands
+  const size_t widths[] = { 1, 3, 4, 5, 7, 8, 9, 13, 17, 31, 33, 67 };
+  const size_t heights[] = { 1, 7, 8, 9, 17 };
+
+  uint32_t state = 11;
+  for( size_t width : widths ) {
+    for( size_t height : heights ) {
+      size_t bytes = 4 * width * height;
+      std::vector<unsigned char> a( bytes ), b( bytes );
+      for( unsigned char& v : a ) v = next_byte( state );
+
+      // identical, alpha differing only
+      b = a;
+      for( size_t i = 3; i < bytes; i += 4 ) b[i] = ~a[i];
+      compare( a, b, width, height );
+
+      // a few small differences
+      b = a;
+      for( size_t i = 0; i < bytes; ++i ) {
+        int d = next_byte( state ) % 9 - 4;
+        if( next_byte( state ) < 64 ) b[i] = std::max( 0, std::min( 255, a[i] + d ) );
+      }
+      compare( a, b, width, height );
+
+      // unrelated
+      for( unsigned char& v : b ) v = next_byte( state );
+      compare( a, b, width, height );
+
+      // black against white, every channel as far apart as it gets
+      std::fill( a.begin(), a.end(), 0 );
+      std::fill( b.begin(), b.end(), 255 );
+      compare( a, b, width, height );
+    }
+  }
+
+  // the squared differences are summed in 32 bit lanes that would overflow
+  // after some 66000 pixels with the largest difference in every channel, a
+  // band of 8 rows this wide goes past that
+  {
+    const size_t width = 8259, height = 11;
+    std::vector<unsigned char> a( 4 * width * height, 0 ), b( a.size(), 255 );
+    compare( a, b, width, height );
+    for( size_t i = 0; i < a.size(); ++i ) b[i] = next_byte( state ) | 0x80;
+    compare( a, b, width, height );
+  }
+
+  // empty images compare as identical
+  ImageMetrics empty = compare_images( nullptr, nullptr, 0, 5 );
+  CHECK( empty.error_count == 0 && empty.ssim == 1 && empty.max_error == 0 );
+
+  CHECK( compared > 0 );
+  return CHECK_RESULT();
+}
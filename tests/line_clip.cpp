@@ -0,0 +1,94 @@
+// Bresenham lines clipped to the target hit exactly the pixels the unclipped
+// line hits inside it. Lines in every octant, steep and shallow, enter (or
+// leave) through each edge of a small target and are compared against the
+// same lines drawn whole into a larger one.
+//
+// The lines are drawn as the canvas outline of an empty document whose
+// transformation squashes the canvas onto the line.
+
+#include "check.h"
+#include "offscreen_renderer.h"
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+using namespace CMU462;
+
+// fixed sequence of numbers in [a, b), the same on every platform
+static double next_double( uint32_t& state, double a, double b ) {
+  state = state * 1664525u + 1013904223u;
+  return a + (b - a) * double(state >> 8) / double(1u << 24);
+}
+
+// halfway between two 1/256 sub-pixel steps, so that the end points snap the
+// same way whatever the target they are drawn into
+static double quantize( double v ) {
+  return ( floor( v * 256 ) + 0.5 ) / 256;
+}
+
+int main() {
+
+  // the small target covers [offset, offset + size) of the large one
+  const size_t large = 400, size = 100, offset = 150;
+  std::vector<unsigned char> whole( 4 * large * large ), clipped( 4 * size * size );
+
+  const char* doc = "<svg width=\"1\" height=\"1\"></svg>";
+  OffscreenRenderer renderer;
+  CHECK( renderer.load( doc, std::string( doc ).size() ) == 0 );
+  renderer.set_line_aa( false );
+  renderer.set_canvas_outline( true );
+
+  // line from a to b, the canvas height maps to nothing
+  auto draw = [&]( double ax, double ay, double bx, double by, double shift,
+                   size_t target, unsigned char* pixels ) {
+    Matrix3x3 m = Matrix3x3::identity();
+    m(0, 0) = bx - ax; m(0, 1) = 0; m(0, 2) = ax - shift;
+    m(1, 0) = by - ay; m(1, 1) = 0; m(1, 2) = ay - shift;
+    renderer.set_size( target, target );
+    renderer.set_transform( m );
+    CHECK( renderer.render( pixels ) == 0 );
+  };
+
+  uint32_t state = 7;
+  int lines = 0, crossing = 0, mismatches = 0;
+  for( int edge = 0; edge < 4; ++edge ) {
+    for( int octant = 0; octant < 8; ++octant ) {
+      for( int i = 0; i < 6; ++i ) {
+
+        // a point on the edge and a direction within the octant, the line
+        // crosses the edge there with 20 to 100 pixels before the crossing
+        // and 5 to 140 after it
+        double t = next_double( state, 0, size );
+        double px = edge == 0 ? 0 : edge == 1 ? size : t;
+        double py = edge == 2 ? 0 : edge == 3 ? size : t;
+        double angle = ( octant + next_double( state, 0.05, 0.95 ) ) * M_PI / 4;
+        double dx = cos( angle ), dy = sin( angle );
+        double before = next_double( state, 20, 100 );
+        double after = next_double( state, 5, 140 );
+        double ax = quantize( offset + px - before * dx );
+        double ay = quantize( offset + py - before * dy );
+        double bx = quantize( offset + px + after * dx );
+        double by = quantize( offset + py + after * dy );
+
+        draw( ax, ay, bx, by, 0, large, &whole[0] );
+        draw( ax, ay, bx, by, offset, size, &clipped[0] );
+
+        bool same = true;
+        for( size_t y = 0; y < size; ++y ) {
+          const unsigned char* row = &whole[4 * ((offset + y) * large + offset)];
+          same &= std::equal( row, row + 4 * size, &clipped[4 * y * size] );
+        }
+        ++lines;
+        if( std::count( clipped.begin(), clipped.end(), 0 ) ) ++crossing;
+        if( !same ) ++mismatches;
+      }
+    }
+  }
+  CHECK( crossing > lines * 9 / 10 );
+  CHECK( mismatches == 0 );
+
+  return CHECK_RESULT();
+}
@@ -0,0 +1,76 @@
+// Edits repainted with render_dirty match a full render of the edited
+// document: elements marked before or after they change, nested in a
+// group, and the first edit after the view moved.
+
+#include "check.h"
+#include "offscreen_renderer.h"
+
+#include <string>
+#include <vector>
+
+using namespace CMU462;
+
+int main() {
+
+  const size_t w = 120, h = 100;
+  std::vector<unsigned char> patched( 4 * w * h ), full( 4 * w * h );
+
+  const char* doc =
+    "<svg width=\"120\" height=\"100\">"
+    "<rect x=\"10\" y=\"10\" width=\"30\" height=\"20\" fill=\"#ff0000\"/>"
+    "<g transform=\"translate(50,40)\">"
+    "<circle cx=\"10\" cy=\"10\" r=\"8\" fill=\"#0000ff\" fill-opacity=\"0.5\"/>"
+    "<polygon points=\"0,30 20,30 10,45\" fill=\"#00ff00\"/>"
+    "</g>"
+    "<polyline points=\"5,90 60,60 115,90\" fill=\"none\" stroke=\"#000000\" stroke-width=\"3\"/>"
+    "</svg>";
+
+  OffscreenRenderer renderer, reference;
+  CHECK( renderer.load( doc, std::string( doc ).size() ) == 0 );
+  CHECK( reference.load( doc, std::string( doc ).size() ) == 0 );
+  OffscreenRenderer* renderers[] = { &renderer, &reference };
+  for( OffscreenRenderer* r : renderers ) {
+    r->set_size( w, h );
+    r->set_canvas_outline( false );
+  }
+
+  SVG& svg = *renderer.svg();
+  SVG& expected = *reference.svg();
+  Group& group = static_cast<Group&>( *svg.elements[1] );
+  Group& expected_group = static_cast<Group&>( *expected.elements[1] );
+
+  // apply the same move to both documents, marking before or after
+  auto move = [&]( SVGElement& element, SVGElement& expected_element,
+                   double dx, double dy, bool mark_first ) {
+    Matrix3x3 shift = Matrix3x3::identity();
+    shift(0, 2) = dx;
+    shift(1, 2) = dy;
+    if( mark_first ) renderer.mark_dirty( &element );
+    element.transform = element.transform * shift;
+    expected_element.transform = element.transform;
+    if( !mark_first ) renderer.mark_dirty( &element );
+    CHECK( renderer.render_dirty( &patched[0] ) == 0 );
+    CHECK( reference.render( &full[0] ) == 0 );
+    CHECK( patched == full );
+  };
+
+  for( int view = 0; view < 3; ++view ) {
+
+    // a new view, the first edit comes before any bounds are known
+    Matrix3x3 m = Matrix3x3::identity();
+    m(0, 0) = m(1, 1) = 1 + 0.1 * view;
+    m(0, 2) = 3.5 * view;
+    m(1, 2) = -2.25 * view;
+    renderer.set_transform( m );
+    reference.set_transform( m );
+    CHECK( renderer.render( &patched[0] ) == 0 );
+
+    move( *svg.elements[0], *expected.elements[0], 20, 5, view % 2 == 0 );
+    move( *svg.elements[0], *expected.elements[0], -15, 30, true );
+    move( *group.elements[0], *expected_group.elements[0], 30, -20, false );
+    move( group, expected_group, -25, 10, true );
+    move( *svg.elements[2], *expected.elements[2], 0, -40, false );
+  }
+
+  return CHECK_RESULT();
+}
@@ -0,0 +1,143 @@
+// Images written by PNGWriter decode back to the same pixels, with a valid
+// checksum on every chunk. Noise leaves nothing to match and is sent as
+// literals, a smooth gradient mixes literals and short matches, and flat or
+// repeating rows give maximum length matches across the whole window.
+// The images are written concurrently, as render_png does for its tiles.
+
+#include "check.h"
+#include "png.h"
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+using namespace CMU462;
+
+struct Image {
+  const char* name;
+  int width, height;
+  std::vector<unsigned char> pixels;
+};
+
+// bit by bit, independent of the table the writer uses
+static uint32_t reference_crc( const unsigned char* data, size_t size ) {
+  uint32_t crc = ~0u;
+  for( size_t i = 0; i < size; ++i ) {
+    crc ^= data[i];
+    for( int k = 0; k < 8; ++k ) crc = (crc >> 1) ^ (0xedb88320u & (0u - (crc & 1)));
+  }
+  return ~crc;
+}
+
+static uint32_t get_u32( const unsigned char* p ) {
+  return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) |
+         (uint32_t(p[2]) << 8) | p[3];
+}
+
+static bool chunks_valid( const std::string& path ) {
+  FILE* file = fopen( path.c_str(), "rb" );
+  if( !file ) return false;
+  std::vector<unsigned char> data;
+  unsigned char buffer[4096];
+  size_t n;
+  while( (n = fread( buffer, 1, sizeof(buffer), file )) > 0 ) {
+    data.insert( data.end(), buffer, buffer + n );
+  }
+  fclose( file );
+
+  size_t pos = 8;
+  bool ended = false;
+  while( pos + 12 <= data.size() ) {
+    size_t size = get_u32( &data[pos] );
+    if( pos + 12 + size > data.size() ) return false;
+    if( reference_crc( &data[pos + 4], size + 4 ) != get_u32( &data[pos + 8 + size] ) )
+      return false;
+    ended = memcmp( &data[pos + 4], "IEND", 4 ) == 0;
+    pos += 12 + size;
+  }
+  return ended && pos == data.size();
+}
+
+static int write_png( const std::string& path, const Image& image ) {
+  PNGWriter writer;
+  if( writer.open( path.c_str(), image.width, image.height ) < 0 ) return -1;
+
+  // rows in batches of different sizes
+  size_t stride = 4 * image.width, y = 0;
+  for( size_t batch = 1; y < size_t(image.height); ++batch ) {
+    size_t rows = std::min( batch, image.height - y );
+    if( writer.write_rows( &image.pixels[y * stride], rows ) < 0 ) return -1;
+    y += rows;
+  }
+  return writer.close();
+}
+
+int main() {
+
+  std::vector<Image> images;
+  uint32_t state = 1;
+
+  // the loader clears the color of transparent pixels, alpha stays above 0
+  Image noise = { "noise", 67, 45, {} };
+  for( int i = 0; i < 4 * 67 * 45; ++i ) {
+    state = state * 1664525u + 1013904223u;
+    noise.pixels.push_back( (state >> 24) | (i % 4 == 3) );
+  }
+  images.push_back( noise );
+
+  Image gradient = { "gradient", 300, 200, {} };
+  for( int y = 0; y < 200; ++y ) {
+    for( int x = 0; x < 300; ++x ) {
+      unsigned char rgba[4] = { (unsigned char) x, (unsigned char) y,
+                                (unsigned char) (x * y / 97), 255 };
+      gradient.pixels.insert( gradient.pixels.end(), rgba, rgba + 4 );
+    }
+  }
+  images.push_back( gradient );
+
+  Image flat = { "flat", 5000, 30, std::vector<unsigned char>( 4 * 5000 * 30, 200 ) };
+  images.push_back( flat );
+
+  // a noisy row repeated with a shift, matches reach back a whole row
+  Image stripes = { "stripes", 3000, 40, {} };
+  std::vector<unsigned char> row;
+  for( int i = 0; i < 4 * 3000; ++i ) {
+    state = state * 1664525u + 1013904223u;
+    row.push_back( (state >> 24) | (i % 4 == 3) );
+  }
+  for( int y = 0; y < 40; ++y ) {
+    for( int i = 0; i < 4 * 3000; ++i ) {
+      stripes.pixels.push_back( row[(i + 4 * (y % 3)) % row.size()] );
+    }
+  }
+  images.push_back( stripes );
+
+  std::vector<int> written( images.size(), -1 );
+  std::vector<std::thread> writers;
+  for( size_t i = 0; i < images.size(); ++i ) {
+    writers.emplace_back( [&images, &written, i]() {
+      written[i] = write_png( std::string( "test_png_" ) + images[i].name + ".png",
+                              images[i] );
+    });
+  }
+  for( std::thread& writer : writers ) writer.join();
+
+  for( size_t i = 0; i < images.size(); ++i ) {
+    const Image& image = images[i];
+    std::string path = std::string( "test_png_" ) + image.name + ".png";
+    CHECK( written[i] == 0 );
+    CHECK( chunks_valid( path ) );
+
+    PNG png;
+    CHECK( PNGParser::load( path.c_str(), png ) >= 0 );
+    CHECK( png.width == image.width && png.height == image.height );
+    CHECK( png.pixels == image.pixels );
+    remove( path.c_str() );
+  }
+
+  return CHECK_RESULT();
+}
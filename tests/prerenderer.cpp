@@ -0,0 +1,276 @@
+// The background renderer draws requested tabs like the viewer would, keeps
+// the frames stored with it until they are evicted, and loads tabs that are
+// not resident from their file. Svgs forgotten while queued or drawn are
+// never drawn or kept afterwards, and svgs loaded in the background count in
+// loaded_bytes until they are handed over, evicted or forgotten.
+//
+// Runs without a window, the fitted views come from the reference viewport
+// as they do in the viewer.
+
+#include "check.h"
+#include "prerenderer.h"
+#include "tab_manager.h"
+#include "viewport.h"
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+
+using namespace CMU462;
+
+static bool write_file( const std::string& path, const std::string& data ) {
+  FILE* file = fopen( path.c_str(), "wb" );
+  if( !file ) return false;
+  bool ok = fwrite( data.data(), 1, data.size(), file ) == data.size();
+  return fclose( file ) == 0 && ok;
+}
+
+// wait for the worker, false if it takes unreasonably long
+template <typename Condition>
+static bool eventually( Condition condition ) {
+  for( int i = 0; i < 20000; ++i ) {
+    if( condition() ) return true;
+    std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+  }
+  return false;
+}
+
+static Prerenderer::View make_view( size_t width, size_t height, double scale ) {
+  Prerenderer::View view;
+  view.width = width;
+  view.height = height;
+  view.svg_2_screen = Matrix3x3::identity();
+  view.svg_2_screen(0, 0) = view.svg_2_screen(1, 1) = scale;
+  view.sample_rate = 2;
+  view.aa_method = SSAA;
+  view.line_aa = true;
+  return view;
+}
+
+// the frame the worker should come up with
+static std::vector<unsigned char> draw( SVG& svg, const Prerenderer::View& view ) {
+  Sampler2DImp sampler;
+  SoftwareRendererImp renderer;
+  std::vector<unsigned char> pixels( 4 * view.width * view.height );
+  renderer.set_tex_sampler( &sampler );
+  renderer.set_render_target( &pixels[0], view.width, view.height );
+  renderer.set_aa_method( view.aa_method );
+  renderer.set_sample_rate( view.sample_rate );
+  renderer.set_line_aa( view.line_aa );
+  renderer.set_svg_2_screen( view.svg_2_screen );
+  renderer.draw_svg( svg );
+  return pixels;
+}
+
+static SVG* parse( const std::string& doc ) {
+  SVG* svg = new SVG();
+  if( SVGParser::load( doc.c_str(), doc.size(), svg ) < 0 ) {
+    delete svg;
+    return nullptr;
+  }
+  return svg;
+}
+
+// a document of n stroked polygons, slow enough to draw that requests made
+// meanwhile stay queued
+static std::string document( int width, int n ) {
+  std::string doc = "<svg width=\"" + std::to_string( width ) + "\" height=\"60\">";
+  for( int i = 0; i < n; ++i ) {
+    int x = i % 40, y = (i / 40) % 40;
+    doc += "<polygon points=\"" + std::to_string( x ) + "," + std::to_string( y ) +
+           " " + std::to_string( x + 20 ) + "," + std::to_string( y + 3 ) +
+           " " + std::to_string( x + 7 ) + "," + std::to_string( y + 18 ) +
+           "\" fill=\"#80ff0000\" stroke=\"#0000ff\"/>";
+  }
+  return doc + "</svg>";
+}
+
+int main() {
+
+  Prerenderer::View view = make_view( 64, 48, 1 );
+  Prerenderer::View other = make_view( 64, 48, 1.5 );
+
+  SVG* a = parse( document( 60, 20 ) );
+  SVG* b = parse( document( 61, 30 ) );
+  SVG* c = parse( document( 62, 10 ) );
+  CHECK( a && b && c );
+
+  // stored frames come back for the same svg and view only
+  {
+    Prerenderer prerenderer( 2 );
+    std::vector<unsigned char> frame( 4 * view.width * view.height ), out( frame.size() );
+    for( size_t i = 0; i < frame.size(); ++i ) frame[i] = i * 7;
+    prerenderer.store( a, view, &frame[0] );
+    CHECK( prerenderer.fetch( a, view, &out[0] ) && out == frame );
+    CHECK( !prerenderer.fetch( a, other, &out[0] ) );
+    CHECK( !prerenderer.fetch( b, view, &out[0] ) );
+    Prerenderer::View changed = view;
+    changed.sample_rate = 3;
+    CHECK( !prerenderer.fetch( a, changed, &out[0] ) );
+    changed = view;
+    changed.line_aa = false;
+    CHECK( !prerenderer.fetch( a, changed, &out[0] ) );
+
+    // the least recently used frame goes first: a was fetched after b was
+    // stored, so c pushes out b
+    prerenderer.store( b, view, &frame[0] );
+    CHECK( prerenderer.fetch( a, view, &out[0] ) );
+    prerenderer.store( c, view, &frame[0] );
+    CHECK( prerenderer.fetch( a, view, &out[0] ) );
+    CHECK( !prerenderer.fetch( b, view, &out[0] ) );
+    CHECK( prerenderer.fetch( c, view, &out[0] ) );
+
+    // and forgetting an svg drops its frames
+    prerenderer.forget( a );
+    CHECK( !prerenderer.fetch( a, view, &out[0] ) );
+    CHECK( prerenderer.loaded_bytes() == 0 );
+  }
+
+  // requested resident svgs are drawn as the viewer draws them
+  {
+    Prerenderer prerenderer;
+    std::vector<Prerenderer::Request> requests( 2 );
+    requests[0].svg = a;
+    requests[0].view = view;
+    requests[0].fit = false;
+    requests[1] = requests[0];
+    requests[1].view = other;
+    prerenderer.request( requests );
+
+    std::vector<unsigned char> out( 4 * view.width * view.height );
+    CHECK( eventually( [&]() { return prerenderer.fetch( a, other, &out[0] ); } ) );
+    CHECK( out == draw( *a, other ) );
+    CHECK( prerenderer.fetch( a, view, &out[0] ) );
+    CHECK( out == draw( *a, view ) );
+    CHECK( prerenderer.loaded_bytes() == 0 );
+  }
+
+  // an svg forgotten while queued is not drawn: with a slow document drawn
+  // first, b is still queued when forgotten, c behind it shows the queue
+  // was worked through
+  {
+    SVG* slow = parse( document( 60, 1000 ) );
+    CHECK( slow );
+    Prerenderer::View large = make_view( 320, 240, 4 );
+    large.sample_rate = 4;
+
+    Prerenderer prerenderer;
+    std::vector<Prerenderer::Request> requests( 3 );
+    requests[0].svg = slow;
+    requests[0].view = large;
+    requests[0].fit = false;
+    requests[1] = requests[0];
+    requests[1].svg = b;
+    requests[1].view = view;
+    requests[2] = requests[1];
+    requests[2].svg = c;
+    prerenderer.request( requests );
+    prerenderer.forget( b );
+
+    std::vector<unsigned char> out( 4 * large.width * large.height );
+    CHECK( eventually( [&]() { return prerenderer.fetch( c, view, &out[0] ); } ) );
+    CHECK( !prerenderer.fetch( b, view, &out[0] ) );
+    CHECK( prerenderer.fetch( slow, large, &out[0] ) );
+
+    // forgotten while (or before) being drawn, nothing is kept of it and it
+    // can go right away
+    requests.resize( 1 );
+    requests[0].svg = slow;
+    requests[0].view = make_view( 320, 240, 5 );
+    requests[0].view.sample_rate = 4;
+    prerenderer.request( requests );
+    prerenderer.forget( slow );
+    delete slow;
+    CHECK( !prerenderer.fetch( slow, requests[0].view, &out[0] ) );
+  }
+
+  // tabs that are not resident are loaded from their file and fit to the
+  // window like a tab shown for the first time
+  const std::string path = "test_prerender.svg";
+  CHECK( write_file( path, document( 80, 25 ) ) );
+  Matrix3x3 norm_to_screen = Matrix3x3::identity();
+  norm_to_screen(0, 0) = norm_to_screen(1, 1) = 48;
+  norm_to_screen(0, 2) = 8;
+  Prerenderer::Request load;
+  load.svg = nullptr;
+  load.path = path;
+  load.view = view;
+  load.fit = true;
+  load.norm_to_screen = norm_to_screen;
+  {
+    Prerenderer prerenderer( 2 );
+    prerenderer.request( std::vector<Prerenderer::Request>( 1, load ) );
+    CHECK( eventually( [&]() { return prerenderer.loaded_bytes() > 0; } ) );
+
+    // counted until handed over, the frame stays
+    size_t bytes = prerenderer.loaded_bytes();
+    SVG* loaded = prerenderer.take_loaded( path );
+    CHECK( loaded && loaded->width == 80 );
+    CHECK( bytes == TabManager::measure( *loaded ) );
+    CHECK( prerenderer.loaded_bytes() == 0 );
+    CHECK( !prerenderer.take_loaded( path ) );
+
+    ViewportRef viewport;
+    viewport.set_viewbox( 40, 30, 1.2 * 80 / 2 );
+    Prerenderer::View fitted = view;
+    fitted.svg_2_screen = norm_to_screen * viewport.get_svg_2_norm();
+    std::vector<unsigned char> out( 4 * view.width * view.height );
+    CHECK( prerenderer.fetch( loaded, fitted, &out[0] ) );
+    CHECK( out == draw( *loaded, fitted ) );
+
+    prerenderer.forget( loaded );
+    CHECK( !prerenderer.fetch( loaded, fitted, &out[0] ) );
+    delete loaded;
+  }
+
+  // a loaded svg no longer counts once forgotten, or evicted with its frame
+  {
+    Prerenderer prerenderer( 2 );
+    prerenderer.request( std::vector<Prerenderer::Request>( 1, load ) );
+    CHECK( eventually( [&]() { return prerenderer.loaded_bytes() > 0; } ) );
+    SVG* loaded = prerenderer.take_loaded( path );
+    CHECK( loaded );
+
+    // given back: requested as a file again it is loaded anew
+    prerenderer.forget( loaded );
+    delete loaded;
+    prerenderer.request( std::vector<Prerenderer::Request>( 1, load ) );
+    CHECK( eventually( [&]() { return prerenderer.loaded_bytes() > 0; } ) );
+
+    // two frames stored after it push its frame out and delete it
+    std::vector<unsigned char> frame( 4 * view.width * view.height );
+    prerenderer.store( a, view, &frame[0] );
+    CHECK( prerenderer.loaded_bytes() > 0 );
+    prerenderer.store( b, view, &frame[0] );
+    CHECK( prerenderer.loaded_bytes() == 0 );
+    CHECK( !prerenderer.take_loaded( path ) );
+
+    // one never handed over goes with the prerenderer
+    prerenderer.request( std::vector<Prerenderer::Request>( 1, load ) );
+    CHECK( eventually( [&]() { return prerenderer.loaded_bytes() > 0; } ) );
+  }
+
+  // files that can not be loaded leave nothing behind
+  {
+    Prerenderer prerenderer;
+    Prerenderer::Request missing = load;
+    missing.path = "test_prerender_missing.svg";
+    std::vector<Prerenderer::Request> requests( 1, missing );
+    requests.push_back( load );
+    requests[1].svg = c;
+    requests[1].fit = false;
+    prerenderer.request( requests );
+    std::vector<unsigned char> out( 4 * view.width * view.height );
+    CHECK( eventually( [&]() { return prerenderer.fetch( c, view, &out[0] ); } ) );
+    CHECK( prerenderer.loaded_bytes() == 0 );
+    CHECK( !prerenderer.take_loaded( missing.path ) );
+  }
+
+  remove( path.c_str() );
+  delete a;
+  delete b;
+  delete c;
+  return CHECK_RESULT();
+}
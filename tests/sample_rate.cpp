@@ -0,0 +1,50 @@
+// Sample rates outside what the renderer supports are rejected, valid ones
+// render in every anti-aliasing mode.
+
+#include "check.h"
+#include "offscreen_renderer.h"
+
+#include <string>
+#include <vector>
+
+using namespace CMU462;
+
+int main() {
+
+  const size_t w = 20, h = 20;
+  std::vector<unsigned char> pixels( 4 * w * h ), before( 4 * w * h );
+
+  // a black square covering pixels 5 to 14, half a pixel off the grid
+  const char* square =
+    "<svg width=\"20\" height=\"20\">"
+    "<rect x=\"5\" y=\"5.5\" width=\"10\" height=\"10\" fill=\"#000000\"/>"
+    "</svg>";
+
+  OffscreenRenderer renderer;
+  CHECK( renderer.load( square, std::string( square ).size() ) == 0 );
+  renderer.set_size( w, h );
+  renderer.set_canvas_outline( false );
+  renderer.set_transform( Matrix3x3::identity() );
+
+  const size_t max_rate = SoftwareRendererImp::kMaxSampleRate;
+  AAMethod methods[] = { SSAA, MSAA };
+  for( AAMethod method : methods ) {
+    renderer.set_aa_method( method );
+    for( size_t rate = 1; rate <= max_rate; ++rate ) {
+      CHECK( renderer.set_sample_rate( rate ) == 0 );
+      CHECK( renderer.render( &pixels[0] ) == 0 );
+      CHECK( pixels[4 * (10 * w + 10)] == 0 );
+      CHECK( pixels[4 * (10 * w + 2)] == 255 );
+
+      // rejected rates keep the current one
+      before = pixels;
+      CHECK( renderer.set_sample_rate( 0 ) < 0 );
+      CHECK( renderer.set_sample_rate( max_rate + 1 ) < 0 );
+      CHECK( renderer.set_sample_rate( 8 ) < 0 );
+      CHECK( renderer.render( &pixels[0] ) == 0 );
+      CHECK( pixels == before );
+    }
+  }
+
+  return CHECK_RESULT();
+}
@@ -0,0 +1,54 @@
+// Translucent strokes in every anti-aliasing mode. The triangles of a stroke
+// mesh overlap at joins and between the two halves of each segment, they
+// have to be blended once so that the stroke has the same alpha throughout.
+
+#include "check.h"
+#include "offscreen_renderer.h"
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+using namespace CMU462;
+
+int main() {
+
+  const size_t w = 100, h = 100;
+  std::vector<unsigned char> pixels( 4 * w * h );
+
+  // a joined polyline with sharp turns, 50% black over white
+  const char* polyline =
+    "<svg width=\"100\" height=\"100\">"
+    "<polyline points=\"10,80 30,20 50,80 70,20 90,80\" fill=\"none\" "
+    "stroke=\"#000000\" stroke-opacity=\"0.5\" stroke-width=\"8\"/>"
+    "</svg>";
+
+  OffscreenRenderer renderer;
+  CHECK( renderer.load( polyline, std::string( polyline ).size() ) == 0 );
+  renderer.set_size( w, h );
+  renderer.set_canvas_outline( false );
+  renderer.set_transform( Matrix3x3::identity() );
+
+  AAMethod methods[] = { SSAA, MSAA, COVERAGE };
+  for( size_t i = 0; i < 3 * 4; ++i ) {
+    renderer.set_aa_method( methods[i / 4] );
+    renderer.set_sample_rate( i % 4 + 1 );
+    CHECK( renderer.render( &pixels[0] ) == 0 );
+
+    // no pixel is darker than the stroke alpha allows
+    unsigned char darkest = 255;
+    for( size_t i = 0; i < w * h; ++i ) {
+      darkest = std::min( darkest, pixels[4 * i] );
+    }
+    CHECK( darkest >= 125 );
+
+    // inside a segment, at a join and at the start
+    const size_t inside[][2] = { { 20, 50 }, { 30, 22 }, { 50, 76 }, { 11, 78 } };
+    for( const auto& p : inside ) {
+      const unsigned char* pixel = &pixels[4 * (p[1] * w + p[0])];
+      CHECK( pixel[0] >= 125 && pixel[0] <= 130 );
+    }
+  }
+
+  return CHECK_RESULT();
+}
@@ -0,0 +1,143 @@
+// Markup the streaming parser skips over: comments and CDATA sections whose
+// terminator overlaps itself ("]]]>", "--->"), and terminators split across
+// the chunks the file is read in. Groups nested too deep are rejected by
+// both the xml and the compiled format.
+
+#include "check.h"
+#include "svg.h"
+#include "svg_binary.h"
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+using namespace CMU462;
+
+static const size_t kChunkSize = 1 << 20;
+
+// number of top level elements, -1 if the document does not load
+static int count_elements( const std::string& xml ) {
+  SVG svg;
+  if( SVGParser::load( xml.data(), xml.size(), &svg ) < 0 ) return -1;
+  return int( svg.elements.size() );
+}
+
+// a rectangle inside the given number of groups
+static std::string nested( size_t depth ) {
+  std::string xml = "<svg width=\"10\" height=\"10\">";
+  for( size_t i = 0; i < depth; ++i ) xml += "<g>";
+  xml += "<rect x=\"1\" y=\"1\" width=\"2\" height=\"2\"/>";
+  for( size_t i = 0; i < depth; ++i ) xml += "</g>";
+  return xml + "</svg>";
+}
+
+static void nest( SVG& svg, size_t depth ) {
+  std::vector<SVGElement*>* elements = &svg.elements;
+  for( size_t i = 0; i < depth; ++i ) {
+    Group* group = new Group();
+    elements->push_back( group );
+    elements = &group->elements;
+  }
+}
+
+static std::vector<char> read_file( const char* path ) {
+  std::ifstream in( path, std::ios::binary );
+  return std::vector<char>( std::istreambuf_iterator<char>(in),
+                            std::istreambuf_iterator<char>() );
+}
+
+static void write_file( const char* path, const std::vector<char>& data ) {
+  std::ofstream out( path, std::ios::binary | std::ios::trunc );
+  out.write( data.data(), data.size() );
+}
+
+int main() {
+
+  const std::string head = "<svg width=\"10\" height=\"10\">";
+  const std::string rect = "<rect x=\"1\" y=\"1\" width=\"2\" height=\"2\"/>";
+  const std::string tail = "</svg>";
+
+  CHECK( count_elements( head + rect + tail ) == 1 );
+
+  // terminators preceded by part of themselves
+  CHECK( count_elements( head + "<![CDATA[ a]]]>" + rect + tail ) == 1 );
+  CHECK( count_elements( head + "<![CDATA[]]]]]>" + rect + tail ) == 1 );
+  CHECK( count_elements( head + "<!-- a --->" + rect + tail ) == 1 );
+  CHECK( count_elements( head + "<!-- a ----->" + rect + tail ) == 1 );
+  CHECK( count_elements( head + "<?xml a?" "?>" + rect + tail ) == 1 );
+
+  // markup that only looks like a terminator stays skipped
+  CHECK( count_elements( head + "<![CDATA[ ]] > ]>" + rect + "]]>" + rect + tail ) == 1 );
+  CHECK( count_elements( head + "<!-- -- > -> " + rect + "-->" + rect + tail ) == 1 );
+
+  // the same terminators across the boundary between two chunks
+  const char* sections[][2] = { { "<![CDATA[", "]]>" }, { "<![CDATA[", "]]]>" },
+                                { "<!--", "--->" } };
+  for( const auto& section : sections ) {
+    std::string terminator = section[1];
+    for( size_t split = 0; split <= terminator.size(); ++split ) {
+      std::string xml = head + rect + section[0];
+      xml.append( kChunkSize - xml.size() - split, ' ' );
+      xml += terminator + rect + tail;
+      CHECK( count_elements( xml ) == 2 );
+    }
+  }
+
+  // group nesting
+  const size_t max_depth = SVGParser::kMaxGroupDepth;
+  CHECK( count_elements( nested( max_depth ) ) == 1 );
+  CHECK( count_elements( nested( max_depth + 1 ) ) == -1 );
+
+  const char* path = "test_svg_parser.dsvgb";
+  for( size_t depth = max_depth; depth <= max_depth + 1; ++depth ) {
+    SVG deep, loaded;
+    nest( deep, depth );
+    CHECK( SVGBinaryParser::save( path, &deep ) == 0 );
+    int status = SVGBinaryParser::load( path, &loaded );
+    CHECK( depth <= max_depth ? status == 0 : status < 0 );
+  }
+
+  // a one pixel image, its mip record (width, height, first texel) sits
+  // right before the 4 texel bytes at the end of the file
+  SVG picture;
+  Image* image = new Image();
+  image->tex.mipmap.resize( 1 );
+  image->tex.mipmap[0].width  = 1;
+  image->tex.mipmap[0].height = 1;
+  image->tex.mipmap[0].texels.assign( 4, 255 );
+  picture.elements.push_back( image );
+  CHECK( SVGBinaryParser::save( path, &picture ) == 0 );
+  const std::vector<char> file = read_file( path );
+  const size_t mip_offset = file.size() - 4 - 3 * sizeof(uint64_t);
+  {
+    SVG loaded;
+    CHECK( SVGBinaryParser::load( path, &loaded ) == 0 );
+  }
+
+  // every truncation is rejected
+  for( size_t size = 1; size < file.size(); ++size ) {
+    SVG loaded;
+    write_file( path, std::vector<char>( file.begin(), file.begin() + size ) );
+    CHECK( SVGBinaryParser::load( path, &loaded ) < 0 );
+  }
+
+  // dimensions whose texel count wraps to 0 or 4 bytes
+  const uint64_t overflows[][2] = { { uint64_t(1) << 62, 1 },
+                                    { uint64_t(1) << 31, uint64_t(1) << 31 },
+                                    { (uint64_t(1) << 62) + 1, 1 },
+                                    { 1, 2 } };
+  for( const auto& dimensions : overflows ) {
+    SVG loaded;
+    std::vector<char> corrupted = file;
+    memcpy( &corrupted[mip_offset], dimensions, sizeof(dimensions) );
+    write_file( path, corrupted );
+    CHECK( SVGBinaryParser::load( path, &loaded ) < 0 );
+  }
+  remove( path );
+
+  return CHECK_RESULT();
+}
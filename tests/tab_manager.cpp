@@ -0,0 +1,200 @@
+// Tabs are released least recently used first until the resident svgs and
+// the bytes held elsewhere fit the budget, never the tab kept or one without
+// a file, and the resident bytes always add up to the svgs' measured size.
+// A released .svg tab comes back from the scene compiled next to it while
+// that is up to date, and from the xml once the svg is edited after it.
+
+#include "check.h"
+#include "tab_manager.h"
+#include "svg_binary.h"
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <ctime>
+#include <utime.h>
+
+using namespace CMU462;
+
+static bool write_file( const std::string& path, const std::string& data ) {
+  FILE* file = fopen( path.c_str(), "wb" );
+  if( !file ) return false;
+  bool ok = fwrite( data.data(), 1, data.size(), file ) == data.size();
+  return fclose( file ) == 0 && ok;
+}
+
+// a document of the given width with a polygon of n points, so that
+// documents differ in size
+static std::string document( int width, int n ) {
+  std::string points;
+  for( int i = 0; i < n; ++i ) {
+    points += std::to_string( i % 50 ) + "," + std::to_string( i / 50 ) + " ";
+  }
+  return "<svg width=\"" + std::to_string( width ) + "\" height=\"10\">"
+         "<polygon points=\"" + points + "\" fill=\"#ff0000\"/></svg>";
+}
+
+static bool set_mtime( const std::string& path, time_t t ) {
+  struct utimbuf times = { t, t };
+  return utime( path.c_str(), &times ) == 0;
+}
+
+// resident bytes as the manager should count them
+static size_t resident( const TabManager& tabs ) {
+  size_t bytes = 0;
+  for( size_t i = 0; i < tabs.size(); ++i ) {
+    if( tabs.svg( i ) ) bytes += TabManager::measure( *tabs.svg( i ) );
+  }
+  return bytes;
+}
+
+static void release( std::vector<SVG*>& released ) {
+  for( SVG* svg : released ) delete svg;
+}
+
+int main() {
+
+  // four files of growing size and a tab without a file
+  TabManager tabs;
+  std::vector<std::string> paths;
+  for( int i = 0; i < 4; ++i ) {
+    paths.push_back( "test_tabs_" + std::to_string( i ) + ".svg" );
+    CHECK( write_file( paths[i], document( 10 + i, 100 * (i + 1) ) ) );
+    tabs.add( paths[i] );
+  }
+  SVG* unsaved = new SVG();
+  std::string doc = document( 99, 1000 );
+  CHECK( SVGParser::load( doc.c_str(), doc.size(), unsaved ) == 0 );
+  tabs.add( unsaved );
+  CHECK( tabs.resident_bytes() == TabManager::measure( *unsaved ) );
+
+  // loaded on first use only, then used in the order 0 2 3 1
+  bool loaded = false;
+  for( size_t i = 0; i < 4; ++i ) {
+    CHECK( !tabs.svg( i ) );
+    CHECK( tabs.acquire( i, &loaded ) && loaded );
+    CHECK( tabs.svg( i )->width == 10 + i );
+  }
+  CHECK( tabs.acquire( 1, &loaded ) && !loaded );
+  CHECK( tabs.resident_bytes() == resident( tabs ) );
+
+  std::vector<size_t> bytes;
+  for( size_t i = 0; i < 4; ++i ) bytes.push_back( TabManager::measure( *tabs.svg( i ) ) );
+  CHECK( bytes[0] < bytes[1] && bytes[1] < bytes[2] && bytes[2] < bytes[3] );
+
+  // within the budget nothing is released
+  tabs.set_budget( tabs.resident_bytes() );
+  CHECK( tabs.trim( 3 ).empty() );
+
+  // one byte over releases the oldest tab
+  SVG* oldest = tabs.svg( 0 );
+  tabs.set_budget( tabs.resident_bytes() - 1 );
+  std::vector<SVG*> released = tabs.trim( 3 );
+  CHECK( released.size() == 1 && released[0] == oldest );
+  CHECK( !tabs.svg( 0 ) && tabs.svg( 1 ) && tabs.svg( 2 ) && tabs.svg( 3 ) );
+  CHECK( tabs.resident_bytes() == resident( tabs ) );
+  release( released );
+
+  // bytes held elsewhere count too: tab 2 goes next, then tab 1, skipping
+  // tab 3 as it is kept
+  SVG* second = tabs.svg( 2 );
+  SVG* third = tabs.svg( 1 );
+  tabs.set_budget( tabs.resident_bytes() );
+  released = tabs.trim( 3, bytes[2] );
+  CHECK( released.size() == 1 && released[0] == second );
+  release( released );
+  tabs.set_budget( tabs.resident_bytes() );
+  released = tabs.trim( 3, 1 );
+  CHECK( released.size() == 1 && released[0] == third );
+  CHECK( tabs.resident_bytes() == resident( tabs ) );
+  release( released );
+
+  // the kept tab and the one without a file stay whatever the budget
+  tabs.set_budget( 0 );
+  CHECK( tabs.trim( 3, 1 << 20 ).empty() );
+  CHECK( tabs.svg( 3 ) && tabs.svg( 4 ) == unsaved );
+  CHECK( tabs.resident_bytes() == bytes[3] + TabManager::measure( *unsaved ) );
+
+  // the tab kept is the one shown, any other may go: with 2 and 1 loaded
+  // again after it, keeping 1 releases 3
+  tabs.set_budget( size_t(512) << 20 );
+  CHECK( tabs.acquire( 2, &loaded ) && loaded );
+  CHECK( tabs.acquire( 1, &loaded ) && loaded );
+  tabs.set_budget( tabs.resident_bytes() - 1 );
+  SVG* kept = tabs.svg( 3 );
+  released = tabs.trim( 1 );
+  CHECK( released.size() == 1 && released[0] == kept );
+  release( released );
+
+  // adopting is only for released tabs
+  SVG* adopted = new SVG();
+  CHECK( SVGParser::load( paths[0].c_str(), adopted ) == 0 );
+  CHECK( !tabs.adopt( 1, adopted ) );
+  CHECK( tabs.adopt( 0, adopted ) && tabs.svg( 0 ) == adopted );
+  CHECK( tabs.resident_bytes() == resident( tabs ) );
+
+  // changes are measured again when asked
+  Polygon* polygon = static_cast<Polygon*>( adopted->elements[0] );
+  polygon->points.resize( polygon->points.size() + 1000 );
+  CHECK( tabs.resident_bytes() != resident( tabs ) );
+  tabs.update_size( 0 );
+  CHECK( tabs.resident_bytes() == resident( tabs ) );
+
+  // removed tabs stop counting
+  tabs.remove( 4 );
+  tabs.remove( 0 );
+  CHECK( tabs.size() == 3 );
+  CHECK( tabs.resident_bytes() == resident( tabs ) );
+
+  // a compiled scene next to the svg: it is told apart by its width
+  std::string source = "test_tabs_c.svg", compiled = "test_tabs_c.dsvgb";
+  CHECK( write_file( source, document( 20, 10 ) ) );
+  {
+    SVG scene;
+    std::string other = document( 30, 10 );
+    CHECK( SVGParser::load( other.c_str(), other.size(), &scene ) == 0 );
+    CHECK( SVGBinaryParser::save( compiled.c_str(), &scene ) == 0 );
+  }
+  time_t now = time( nullptr );
+  CHECK( set_mtime( source, now - 100 ) && set_mtime( compiled, now - 50 ) );
+  CHECK( SVGBinaryParser::compiled_path( source ) == compiled );
+
+  TabManager scenes;
+  scenes.add( source );
+  scenes.add( paths[3] );
+  CHECK( scenes.acquire( 0 ) && scenes.svg( 0 )->width == 30 );
+
+  // released and loaded again it still comes from the compiled scene
+  scenes.acquire( 1 );
+  scenes.set_budget( 0 );
+  released = scenes.trim( 1 );
+  CHECK( released.size() == 1 && !scenes.svg( 0 ) );
+  release( released );
+  CHECK( scenes.acquire( 0, &loaded ) && loaded && scenes.svg( 0 )->width == 30 );
+
+  // an svg edited after it was compiled is parsed again
+  CHECK( set_mtime( source, now ) );
+  CHECK( SVGBinaryParser::compiled_path( source ).empty() );
+  released = scenes.trim( 1 );
+  release( released );
+  CHECK( scenes.acquire( 0, &loaded ) && loaded && scenes.svg( 0 )->width == 20 );
+
+  // and so is one whose compiled scene does not load
+  CHECK( write_file( compiled, "not a compiled scene" ) );
+  CHECK( set_mtime( compiled, now + 50 ) );
+  CHECK( SVGBinaryParser::compiled_path( source ) == compiled );
+  released = scenes.trim( 1 );
+  release( released );
+  CHECK( scenes.acquire( 0, &loaded ) && loaded && scenes.svg( 0 )->width == 20 );
+  CHECK( scenes.svg( 0 )->elements.size() == 1 );
+
+  // tabs whose file is gone can not be loaded
+  released = scenes.trim( 1 );
+  release( released );
+  remove( source.c_str() );
+  remove( compiled.c_str() );
+  CHECK( !scenes.acquire( 0 ) );
+
+  for( const std::string& path : paths ) remove( path.c_str() );
+  return CHECK_RESULT();
+}
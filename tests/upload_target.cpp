@@ -0,0 +1,150 @@
+// Frames resolved into an upload target come out there bottom row first,
+// exactly as a plain render lays them out top row first, and leave the
+// render target alone. The render target gets the frame from the samples
+// kept when asked, before a partial redraw, and before new settings lay the
+// buffers out again, for every anti-aliasing method and sample rate.
+
+#include "check.h"
+#include "software_renderer.h"
+#include "texture.h"
+
+#include <string>
+#include <vector>
+#include <cstring>
+
+using namespace CMU462;
+
+static const size_t w = 90, h = 70;
+static const unsigned char kUntouched = 0x5a;
+
+// the frame top row first, as it is in the render target
+static std::vector<unsigned char> flip( const std::vector<unsigned char>& pixels ) {
+  std::vector<unsigned char> flipped( pixels.size() );
+  for( size_t y = 0; y < h; ++y ) {
+    memcpy( &flipped[4 * y * w], &pixels[4 * (h - 1 - y) * w], 4 * w );
+  }
+  return flipped;
+}
+
+static void untouch( std::vector<unsigned char>& pixels ) {
+  pixels.assign( 4 * w * h, kUntouched );
+}
+
+static bool untouched( const std::vector<unsigned char>& pixels ) {
+  for( unsigned char v : pixels ) {
+    if( v != kUntouched ) return false;
+  }
+  return true;
+}
+
+int main() {
+
+  // rows with nothing on them, fills, strokes and a line
+  const char* doc =
+    "<svg width=\"90\" height=\"60\">"
+    "<rect x=\"10\" y=\"12\" width=\"30\" height=\"20\" fill=\"#ff0000\"/>"
+    "<polygon points=\"40,10 80,20 55,45\" fill=\"#0000ff\" fill-opacity=\"0.5\" stroke=\"#000000\"/>"
+    "<line x1=\"5\" y1=\"50\" x2=\"85\" y2=\"40\" stroke=\"#00a000\"/>"
+    "</svg>";
+  SVG svg, expected_svg;
+  CHECK( SVGParser::load( doc, strlen( doc ), &svg ) == 0 );
+  CHECK( SVGParser::load( doc, strlen( doc ), &expected_svg ) == 0 );
+
+  Matrix3x3 view = Matrix3x3::identity();
+  view(0, 2) = 0.25;
+  view(1, 2) = 3.5;
+
+  const AAMethod methods[] = { SSAA, MSAA, COVERAGE };
+  for( AAMethod method : methods ) {
+    for( size_t rate = 1; rate <= SoftwareRendererImp::kMaxSampleRate; ++rate ) {
+
+      Sampler2DImp sampler;
+      SoftwareRendererImp renderer, reference;
+      std::vector<unsigned char> target, expected( 4 * w * h ), upload( 4 * w * h );
+      untouch( target );
+      for( SoftwareRendererImp* r : { &renderer, &reference } ) {
+        r->set_tex_sampler( &sampler );
+        r->set_aa_method( method );
+        r->set_sample_rate( rate );
+        r->set_svg_2_screen( view );
+      }
+      renderer.set_render_target( &target[0], w, h );
+      reference.set_render_target( &expected[0], w, h );
+
+      // a frame drawn the way the viewer draws it
+      auto draw = [&]() {
+        untouch( target );
+        renderer.set_upload_target( &upload[0] );
+        renderer.draw_svg( svg );
+        renderer.set_upload_target( nullptr );
+      };
+
+      reference.draw_svg( expected_svg );
+      draw();
+      CHECK( flip( upload ) == expected );
+      CHECK( untouched( target ) );
+      renderer.update_render_target();
+      CHECK( target == expected );
+
+      // once is enough
+      untouch( target );
+      renderer.update_render_target();
+      CHECK( untouched( target ) );
+
+      // frames drawn without an upload target go to the render target
+      renderer.draw_svg( svg );
+      CHECK( target == expected );
+      renderer.update_render_target();
+      CHECK( target == expected );
+
+      // a partial redraw patches the whole frame: with the bounds recorded
+      // by a first redraw only the damage is drawn again
+      draw();
+      renderer.redraw_dirty( svg );
+      draw();
+      Matrix3x3 original = svg.elements[0]->transform;
+      Matrix3x3 shift = Matrix3x3::identity();
+      shift(0, 2) = 7;
+      shift(1, 2) = -4;
+      renderer.mark_dirty( svg.elements[0] );
+      svg.elements[0]->transform = svg.elements[0]->transform * shift;
+      expected_svg.elements[0]->transform = svg.elements[0]->transform;
+      renderer.redraw_dirty( svg );
+      reference.draw_svg( expected_svg );
+      CHECK( target == expected );
+
+      // new settings keep the frame drawn with the old ones
+      draw();
+      renderer.set_sample_rate( rate % SoftwareRendererImp::kMaxSampleRate + 1 );
+      CHECK( target == expected );
+      renderer.set_sample_rate( rate );
+
+      draw();
+      renderer.set_aa_method( method == MSAA ? SSAA : MSAA );
+      CHECK( target == expected );
+      renderer.set_aa_method( method );
+
+      // a target of the same size can still take the frame, one of another
+      // size can not
+      draw();
+      std::vector<unsigned char> other;
+      untouch( other );
+      renderer.set_render_target( &other[0], w, h );
+      renderer.update_render_target();
+      CHECK( other == expected );
+
+      draw();
+      std::vector<unsigned char> larger( 4 * (w + 1) * h, kUntouched );
+      renderer.set_render_target( &larger[0], w + 1, h );
+      renderer.update_render_target();
+      bool kept = true;
+      for( unsigned char v : larger ) kept &= v == kUntouched;
+      CHECK( kept );
+
+      // back for the next round
+      svg.elements[0]->transform = expected_svg.elements[0]->transform = original;
+    }
+  }
+
+  return CHECK_RESULT();
+}